@@ -0,0 +1,126 @@
+#include "engine/memory/AllocTraceRecorder.h"
+#include "engine/system/Assert.h"
+
+namespace bbengine
+{
+    namespace mem
+    {
+        /*====================================================================
+
+            AllocTraceRecorder::AllocTraceRecorder
+
+        ====================================================================*/
+        AllocTraceRecorder::AllocTraceRecorder( )
+            : m_file( NULL )
+            , m_events( sizeof( alloc_trace_event_s ), EVENTS_PER_BUFFER )
+        {
+        }
+
+
+        /*====================================================================
+
+            AllocTraceRecorder::~AllocTraceRecorder
+            - stops recording. the writer releases the buffers
+
+        ====================================================================*/
+        AllocTraceRecorder::~AllocTraceRecorder( )
+        {
+            Stop();
+        }
+
+
+        /*====================================================================
+
+            AllocTraceRecorder::Start( const char* path )
+            - opens the trace file, writes the header and starts the
+              background writer thread
+            - @return: false if the file could not be opened
+
+        ====================================================================*/
+        bool AllocTraceRecorder::Start( const char* path )
+        {
+            DEBUG_ASSERT( m_file == NULL && "Trace recorder already started" );
+
+            FILE* file = fopen( path, "wb" );
+
+            if( file == NULL )
+            {
+                return false;
+            }
+
+            alloc_trace_header_s header;
+            header.magic = ALLOC_TRACE_MAGIC;
+            header.version = ALLOC_TRACE_VERSION;
+            header.eventSize = sizeof( alloc_trace_event_s );
+            header.reserved = 0;
+
+            fwrite( &header, sizeof( header ), 1, file );
+
+            m_file = file;
+            m_events.Start( &AllocTraceRecorder::WriteEvents, this );
+
+            return true;
+        }
+
+
+        /*====================================================================
+
+            AllocTraceRecorder::Stop
+            - writes out every thread's events and closes the file
+
+        ====================================================================*/
+        void AllocTraceRecorder::Stop( )
+        {
+            m_events.Stop();
+
+            if( m_file )
+            {
+                fclose( m_file );
+                m_file = NULL;
+            }
+        }
+
+
+        /*====================================================================
+
+            AllocTraceRecorder::Record
+            - appends an event to the calling thread's buffer
+            - tag is the tag of the block, which a free can be recorded
+              under even when the freeing thread's current tag differs
+
+        ====================================================================*/
+        void AllocTraceRecorder::Record( alloc_trace_event_e type, u64 timestamp, void* ptr, u32 size, align_t alignment, memtag_t tag )
+        {
+            if( !m_events.IsRunning() )
+            {
+                return;
+            }
+
+            alloc_trace_event_s event;
+
+            event.timestamp = timestamp;
+            event.ptr = ( u64 )( size_t )ptr;
+            event.size = size;
+            event.type = ( u8 )type;
+            event.alignment = ( u8 )__builtin_ctz( ( u32 )alignment );
+            event.tag = tag;
+
+            m_events.Write( &event );
+        }
+
+
+        /*====================================================================
+
+            AllocTraceRecorder::WriteEvents
+            - writes a buffer of events to the file, on the writer thread
+
+        ====================================================================*/
+        void AllocTraceRecorder::WriteEvents( void* userData, const void* events, u32 count, u32 threadId )
+        {
+            ( void )threadId;
+
+            AllocTraceRecorder* recorder = ( AllocTraceRecorder* )userData;
+            fwrite( events, sizeof( alloc_trace_event_s ), count, recorder->m_file );
+        }
+    }
+}
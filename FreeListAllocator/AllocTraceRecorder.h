@@ -0,0 +1,129 @@
+#ifndef _BB_ALLOC_TRACE_RECORDER_H_ // [ _BB_ALLOC_TRACE_RECORDER_H_
+#define _BB_ALLOC_TRACE_RECORDER_H_
+
+#include "engine/memory/FreeListPolicies.h"
+#include "engine/memory/MemoryTags.h"
+#include "engine/memory/ThreadBufferedWriter.h"
+#include <stdio.h>
+
+namespace bbengine
+{
+    namespace mem
+    {
+        /*====================================================================
+
+            Allocation trace file layout:
+            - alloc_trace_header_s
+            - alloc_trace_event_s records until the end of the file
+
+            events are written a thread's buffer at a time, so they are
+            only ordered by timestamp within a thread. readers should sort
+            by timestamp before replaying
+
+        ====================================================================*/
+
+        #define ALLOC_TRACE_MAGIC       0x54414242u     // "BBAT"
+        #define ALLOC_TRACE_VERSION     1
+
+        enum alloc_trace_event_e
+        {
+            ALLOC_TRACE_ALLOCATE        = 0,
+            ALLOC_TRACE_FREE            = 1,
+        };
+
+        struct alloc_trace_header_s
+        {
+            u32     magic;
+            u32     version;
+            u32     eventSize;      // sizeof( alloc_trace_event_s )
+            u32     reserved;
+        };
+
+        struct alloc_trace_event_s
+        {
+            u64     timestamp;      // ReadCycleCounter() on entry to the call
+            u64     ptr;            // pointer returned or freed. 0 for a failed allocation
+            u32     size;           // bytes requested. 0 for frees
+            u8      type;           // alloc_trace_event_e
+            u8      alignment;      // log2 of the requested alignment
+            u16     tag;            // memtag_t of the block allocated or freed
+        };
+
+
+        // Records allocation events to a binary trace file. Events are
+        // buffered per thread by a ThreadBufferedWriter, whose background
+        // thread writes them out, so recording an event is a thread local
+        // lookup and a 24 byte copy. A thread's events are written when its
+        // buffer fills, when it calls FlushThread or exits, and when the
+        // recorder stops
+        class AllocTraceRecorder
+        {
+        public:
+            AllocTraceRecorder( );
+            ~AllocTraceRecorder( );
+
+            // opens the trace file and starts the writer thread
+            bool            Start( const char* path );
+            // writes out every thread's events and closes the file
+            void            Stop( );
+
+            void            Record( alloc_trace_event_e type, u64 timestamp, void* ptr, u32 size, align_t alignment, memtag_t tag );
+            // hands the calling thread's partially filled buffer to the writer
+            void            FlushThread( )          { m_events.FlushThread(); }
+
+            bool            IsRecording( ) const    { return m_events.IsRunning(); }
+            // events lost because a buffer could not be allocated
+            u64             GetDroppedEvents( ) const   { return m_events.GetDroppedEvents(); }
+
+            static const u32 EVENTS_PER_BUFFER = 4096;
+
+        private:
+            AllocTraceRecorder( AllocTraceRecorder& );
+
+            static void     WriteEvents( void* userData, const void* events, u32 count, u32 threadId );
+
+            FILE*                   m_file;         // only used by Start, Stop and the writer thread
+            ThreadBufferedWriter    m_events;
+        };
+
+
+        // StatsPolicy that records every AllocateAligned and Free call made
+        // through the allocator. Allocate is recorded as an 8-byte aligned
+        // AllocateAligned, which is what it is
+        class TraceStatsPolicy : public NullStatsPolicy
+        {
+        public:
+            TraceStatsPolicy( ) : m_recorder( NULL ) {}
+
+            static const bool TIMED_OPERATIONS = true;
+
+            void SetRecorder( AllocTraceRecorder* recorder )    { m_recorder = recorder; }
+
+            void OnAllocateDone( u64 startTime, u32 numBytes, align_t alignment, void* ptr, u32 tag, u32 blocksVisited )
+            {
+                ( void )blocksVisited;
+
+                if( m_recorder )
+                {
+                    m_recorder->Record( ALLOC_TRACE_ALLOCATE, startTime, ptr, numBytes, alignment, ( memtag_t )tag );
+                }
+            }
+
+            void OnFreeDone( u64 startTime, void* ptr, u32 tag, u32 blocksVisited )
+            {
+                ( void )blocksVisited;
+
+                if( m_recorder )
+                {
+                    m_recorder->Record( ALLOC_TRACE_FREE, startTime, ptr, 0, ALIGN_8, ( memtag_t )tag );
+                }
+            }
+
+        private:
+            AllocTraceRecorder*     m_recorder;
+        };
+    }
+}
+
+
+#endif // ] _BB_ALLOC_TRACE_RECORDER_H_
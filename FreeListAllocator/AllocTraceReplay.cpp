@@ -0,0 +1,427 @@
+/*====================================================================
+
+    AllocTraceReplay
+    - replays a trace written by AllocTraceRecorder against one or more
+      Allocator implementations and reports how each one did
+    - Replay only goes through the Allocator interface. to compare
+      another allocator, add it to REPLAY_TARGETS with the bytes it
+      spends on each block on top of GetBlockSize
+
+    usage: AllocTraceReplay <trace file> [heap size in MiB] [allocators...]
+    allocators: freelist, outofband, malloc ( default: all of them )
+
+====================================================================*/
+#include "engine/memory/FreeListAllocator.h"
+#include "engine/memory/OutOfBandFreeListAllocator.h"
+#include "engine/memory/AllocTraceRecorder.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined( __GLIBC__ )
+#include <malloc.h>
+#endif
+#include <algorithm>
+#include <chrono>
+#include <unordered_map>
+#include <vector>
+
+using namespace bbengine;
+using namespace bbengine::mem;
+
+namespace
+{
+    // Allocator over the C runtime heap, as a baseline
+    class MallocAllocator : public Allocator
+    {
+    public:
+        using Allocator::AllocateAligned;
+        using Allocator::Free;
+
+        virtual void*   Allocate( u32 numBytes )                                { return malloc( numBytes ); }
+        virtual void*   AllocateAligned( u32 numBytes, const align_t alignment )
+        {
+            void* ptr = NULL;
+            size_t align = ( size_t )alignment < sizeof( void* ) ? sizeof( void* ) : ( size_t )alignment;
+            return posix_memalign( &ptr, align, numBytes ) == 0 ? ptr : NULL;
+        }
+        virtual void    Free( void* ptr )                                       { free( ptr ); }
+        virtual u32     GetBlockSize( void* ptr )
+        {
+#if defined( __GLIBC__ )
+            return ( u32 )malloc_usable_size( ptr );
+#else
+            // unknown, Replay falls back to the requested size
+            ( void )ptr;
+            return 0;
+#endif
+        }
+    };
+
+    struct replay_result_s
+    {
+        double  totalSeconds;
+        u64     allocations;
+        u64     frees;
+        u64     failedAllocations;  // allocations that failed on replay
+        u64     recordedFailures;   // allocations that failed when recorded but not on replay
+        u64     skippedFrees;       // frees of blocks that failed to allocate on replay
+        u64     reusedPointers;     // allocations recorded at a pointer that was never freed. the
+                                    // block replayed for it is freed, untimed, before the new one
+        u64     peakLiveBytes;      // highest sum of requested bytes in use
+        u64     peakBytesInUse;     // highest sum of the bytes the allocator spent on the blocks in
+                                    // use, including headers and size rounding
+        u64     peakSpan;           // highest distance from the lowest to the highest byte in use
+        std::vector< u32 > latencies;   // ns per operation
+
+        replay_result_s( )
+            : totalSeconds( 0.0 ), allocations( 0 ), frees( 0 ), failedAllocations( 0 )
+            , recordedFailures( 0 ), skippedFrees( 0 ), reusedPointers( 0 ), peakLiveBytes( 0 )
+            , peakBytesInUse( 0 ), peakSpan( 0 )
+        {
+        }
+    };
+
+
+    typedef std::vector< alloc_trace_event_s > events_t;
+
+    void Replay( Allocator& allocator, u32 blockOverhead, const events_t& events, replay_result_s& result );
+
+    // an allocator the tool can replay against. replay sets the allocator
+    // up on its own stack and passes it to Replay, returning false if it
+    // could not be set up. blockOverhead is the bytes each block costs on
+    // top of GetBlockSize, ie its header
+    struct replay_target_s
+    {
+        const char* name;
+        bool        ( *replay )( u32 heapSize, u32 maxBlocks, u32 blockOverhead, const events_t& events, replay_result_s& result );
+        u32         blockOverhead;
+    };
+
+    bool ReplayFreeList( u32 heapSize, u32 maxBlocks, u32 blockOverhead, const events_t& events, replay_result_s& result )
+    {
+        ( void )maxBlocks;
+
+        FreeListAllocator allocator( heapSize );
+        Replay( allocator, blockOverhead, events, result );
+
+        return true;
+    }
+
+    bool ReplayOutOfBand( u32 heapSize, u32 maxBlocks, u32 blockOverhead, const events_t& events, replay_result_s& result )
+    {
+        OutOfBandFreeListAllocator allocator( heapSize, maxBlocks );
+
+        if( !allocator.IsInitialized() )
+        {
+            return false;
+        }
+
+        Replay( allocator, blockOverhead, events, result );
+
+        return true;
+    }
+
+    bool ReplayMalloc( u32 heapSize, u32 maxBlocks, u32 blockOverhead, const events_t& events, replay_result_s& result )
+    {
+        ( void )heapSize; ( void )maxBlocks;
+
+        MallocAllocator allocator;
+        Replay( allocator, blockOverhead, events, result );
+
+        return true;
+    }
+
+    const replay_target_s REPLAY_TARGETS[] =
+    {
+        { "freelist",   ReplayFreeList,     DefaultFreeListAllocator::ALIGNED_HEADER_SIZE },
+        { "outofband",  ReplayOutOfBand,    0 },
+        { "malloc",     ReplayMalloc,       sizeof( size_t ) },    // glibc's chunk size field
+    };
+
+    const size_t NUM_REPLAY_TARGETS = sizeof( REPLAY_TARGETS ) / sizeof( REPLAY_TARGETS[ 0 ] );
+
+
+    /*====================================================================
+
+        LoadTrace
+        - reads every event in a trace and sorts them by timestamp, since
+          each thread's events are written a buffer at a time
+
+    ====================================================================*/
+    bool LoadTrace( const char* path, std::vector< alloc_trace_event_s >& events )
+    {
+        FILE* file = fopen( path, "rb" );
+
+        if( file == NULL )
+        {
+            fprintf( stderr, "unable to open %s\n", path );
+            return false;
+        }
+
+        alloc_trace_header_s header;
+
+        if( fread( &header, sizeof( header ), 1, file ) != 1 || header.magic != ALLOC_TRACE_MAGIC ||
+            header.version != ALLOC_TRACE_VERSION || header.eventSize != sizeof( alloc_trace_event_s ) )
+        {
+            fprintf( stderr, "%s is not a supported allocation trace\n", path );
+            fclose( file );
+            return false;
+        }
+
+        alloc_trace_event_s event;
+
+        while( fread( &event, sizeof( event ), 1, file ) == 1 )
+        {
+            events.push_back( event );
+        }
+
+        fclose( file );
+
+        std::stable_sort( events.begin(), events.end(),
+                          []( const alloc_trace_event_s& a, const alloc_trace_event_s& b ) { return a.timestamp < b.timestamp; } );
+
+        return true;
+    }
+
+
+    /*====================================================================
+
+        Replay
+        - runs every event against allocator, mapping recorded pointers to
+          the pointers the allocator handed back
+        - the bytes in use for a block are its GetBlockSize plus
+          blockOverhead, or the requested size if the allocator does not
+          know the block's size
+
+    ====================================================================*/
+    void Replay( Allocator& allocator, u32 blockOverhead, const events_t& events, replay_result_s& result )
+    {
+        struct live_s
+        {
+            void*   ptr;
+            u32     size;
+            u32     bytesInUse;
+        };
+
+        std::unordered_map< u64, live_s > live;
+        live.reserve( events.size() / 2 );
+
+        result.latencies.reserve( events.size() );
+
+        u64 liveBytes = 0;
+        u64 bytesInUse = 0;
+        size_t lowest = ~( size_t )0;
+        size_t highest = 0;
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        for( size_t i = 0; i < events.size(); ++i )
+        {
+            const alloc_trace_event_s& event = events[ i ];
+
+            if( event.type == ALLOC_TRACE_ALLOCATE )
+            {
+                std::chrono::steady_clock::time_point opStart = std::chrono::steady_clock::now();
+                void* ptr = allocator.AllocateAligned( event.size, ( align_t )( 1u << event.alignment ) );
+                std::chrono::steady_clock::time_point opEnd = std::chrono::steady_clock::now();
+
+                result.latencies.push_back( ( u32 )std::chrono::duration_cast< std::chrono::nanoseconds >( opEnd - opStart ).count() );
+                ++result.allocations;
+
+                if( ptr == NULL )
+                {
+                    ++result.failedAllocations;
+                    continue;
+                }
+
+                if( event.ptr == 0 )
+                {
+                    // failed when it was recorded, so the program never used
+                    // or freed it. give it straight back
+                    ++result.recordedFailures;
+                    allocator.Free( ptr );
+                    continue;
+                }
+
+                u32 blockSize = allocator.GetBlockSize( ptr );
+                live_s block = { ptr, event.size, ( blockSize ? blockSize : event.size ) + blockOverhead };
+
+                std::pair< std::unordered_map< u64, live_s >::iterator, bool > inserted = live.insert( std::make_pair( event.ptr, block ) );
+
+                if( !inserted.second )
+                {
+                    // the recorded pointer is still live, so its free was
+                    // lost from the trace. free the old block rather than
+                    // leak it
+                    ++result.reusedPointers;
+
+                    allocator.Free( inserted.first->second.ptr );
+                    liveBytes -= inserted.first->second.size;
+                    bytesInUse -= inserted.first->second.bytesInUse;
+                    inserted.first->second = block;
+                }
+
+                liveBytes += block.size;
+                bytesInUse += block.bytesInUse;
+                lowest = std::min( lowest, ( size_t )ptr );
+                highest = std::max( highest, ( size_t )ptr + event.size );
+
+                result.peakLiveBytes = std::max( result.peakLiveBytes, liveBytes );
+                result.peakBytesInUse = std::max( result.peakBytesInUse, bytesInUse );
+                result.peakSpan = std::max( result.peakSpan, ( u64 )( highest - lowest ) );
+            }
+            else if( event.type == ALLOC_TRACE_FREE )
+            {
+                std::unordered_map< u64, live_s >::iterator it = live.find( event.ptr );
+
+                if( it == live.end() )
+                {
+                    ++result.skippedFrees;
+                    continue;
+                }
+
+                std::chrono::steady_clock::time_point opStart = std::chrono::steady_clock::now();
+                allocator.Free( it->second.ptr );
+                std::chrono::steady_clock::time_point opEnd = std::chrono::steady_clock::now();
+
+                result.latencies.push_back( ( u32 )std::chrono::duration_cast< std::chrono::nanoseconds >( opEnd - opStart ).count() );
+                ++result.frees;
+
+                liveBytes -= it->second.size;
+                bytesInUse -= it->second.bytesInUse;
+                live.erase( it );
+            }
+        }
+
+        result.totalSeconds = std::chrono::duration< double >( std::chrono::steady_clock::now() - start ).count();
+
+        // leave the allocator empty for the next run
+        for( std::unordered_map< u64, live_s >::iterator it = live.begin(); it != live.end(); ++it )
+        {
+            allocator.Free( it->second.ptr );
+        }
+    }
+
+
+    u32 Percentile( const std::vector< u32 >& sorted, double percentile )
+    {
+        if( sorted.empty() )
+        {
+            return 0;
+        }
+
+        size_t index = ( size_t )( percentile / 100.0 * ( double )( sorted.size() - 1 ) + 0.5 );
+        return sorted[ index ];
+    }
+
+
+    void Report( const char* name, replay_result_s& result )
+    {
+        std::sort( result.latencies.begin(), result.latencies.end() );
+
+        printf( "%s\n", name );
+        printf( "  total time          %.3f ms\n", result.totalSeconds * 1000.0 );
+        printf( "  allocations         %llu ( %llu failed, %llu failed only when recorded )\n", ( unsigned long long )result.allocations,
+                ( unsigned long long )result.failedAllocations, ( unsigned long long )result.recordedFailures );
+        printf( "  frees               %llu ( %llu skipped, %llu pointers reused without a free )\n", ( unsigned long long )result.frees,
+                ( unsigned long long )result.skippedFrees, ( unsigned long long )result.reusedPointers );
+        printf( "  latency ns          p50 %u  p90 %u  p99 %u  p99.9 %u  max %u\n",
+                Percentile( result.latencies, 50.0 ), Percentile( result.latencies, 90.0 ), Percentile( result.latencies, 99.0 ),
+                Percentile( result.latencies, 99.9 ), result.latencies.empty() ? 0 : result.latencies.back() );
+        printf( "  peak live bytes     %llu requested\n", ( unsigned long long )result.peakLiveBytes );
+        printf( "  peak bytes in use   %llu\n", ( unsigned long long )result.peakBytesInUse );
+        printf( "  peak address span   %llu\n", ( unsigned long long )result.peakSpan );
+    }
+
+
+    void Run( const replay_target_s& target, u32 heapSize, const events_t& events )
+    {
+        replay_result_s result;
+        u32 maxBlocks = ( u32 )std::min( events.size() / 2 + 1, ( size_t )0x0FFFFFFF );
+
+        if( !target.replay( heapSize, maxBlocks, target.blockOverhead, events, result ) )
+        {
+            fprintf( stderr, "unable to set up %s with a %u MiB heap\n", target.name, heapSize >> 20 );
+            return;
+        }
+
+        Report( target.name, result );
+    }
+}
+
+
+int main( int argc, char** argv )
+{
+    if( argc < 2 )
+    {
+        fprintf( stderr, "usage: %s <trace file> [heap size in MiB] [freelist|outofband|malloc...]\n", argv[ 0 ] );
+        return 1;
+    }
+
+    std::vector< alloc_trace_event_s > events;
+
+    if( !LoadTrace( argv[ 1 ], events ) )
+    {
+        return 1;
+    }
+
+    // the heap size is a u32, so at most 4095 MiB
+    u32 heapMiB = 256;
+
+    if( argc > 2 )
+    {
+        char* end = NULL;
+        unsigned long value = strtoul( argv[ 2 ], &end, 10 );
+
+        if( end == argv[ 2 ] || *end != '\0' || value == 0 || value >= 4096 )
+        {
+            fprintf( stderr, "heap size must be 1 to 4095 MiB, not %s\n", argv[ 2 ] );
+            return 1;
+        }
+
+        heapMiB = ( u32 )value;
+    }
+
+    u32 heapSize = heapMiB << 20;
+
+    std::vector< const replay_target_s* > targets;
+
+    for( int i = 3; i < argc; ++i )
+    {
+        const replay_target_s* target = NULL;
+
+        for( size_t j = 0; j < NUM_REPLAY_TARGETS && target == NULL; ++j )
+        {
+            if( strcmp( argv[ i ], REPLAY_TARGETS[ j ].name ) == 0 )
+            {
+                target = &REPLAY_TARGETS[ j ];
+            }
+        }
+
+        if( target )
+        {
+            targets.push_back( target );
+        }
+        else
+        {
+            fprintf( stderr, "unknown allocator %s\n", argv[ i ] );
+        }
+    }
+
+    if( argc <= 3 )
+    {
+        for( size_t i = 0; i < NUM_REPLAY_TARGETS; ++i )
+        {
+            targets.push_back( &REPLAY_TARGETS[ i ] );
+        }
+    }
+
+    printf( "%s: %llu events, %u MiB heap\n", argv[ 1 ], ( unsigned long long )events.size(), heapMiB );
+
+    for( size_t i = 0; i < targets.size(); ++i )
+    {
+        Run( *targets[ i ], heapSize, events );
+    }
+
+    return 0;
+}
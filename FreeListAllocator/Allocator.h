@@ -3,12 +3,25 @@
 
 #include "engine/system/System.h"
 #include "engine/memory/MemoryUtils.h"
+#include "engine/memory/MemoryTags.h"
 
 namespace bbengine
 {
     namespace mem
     {
-        // Base Allocator class. ALL Allocators must inherit from and implement Allocator
+        // result of an AllocateAtLeast request. size is the number of bytes
+        // usable at ptr, which may be larger than the number requested
+        struct allocation_s
+        {
+            void*   ptr;
+            u32     size;
+        };
+
+        // Base Allocator class. ALL Allocators must inherit from and implement Allocator.
+        // AllocateAligned and Free are overloaded, so an allocator that only
+        // overrides the pure virtual versions must bring the others in with
+        // using Allocator::AllocateAligned and using Allocator::Free, or they
+        // are hidden when it is called through its own type
         class Allocator
         {
         public:
@@ -20,6 +33,31 @@ namespace bbengine
             virtual void    Free( void* ptr ) = 0;
             // returns the size of the block of memory that ptr points to
             virtual u32     GetBlockSize( void* ptr ) = 0;
+
+            // allocate at least numBytes and report how many bytes are actually
+            // usable, so callers can make use of any slack in the block
+            virtual allocation_s AllocateAtLeast( u32 numBytes, const align_t alignment = ALIGN_8 )
+            {
+                allocation_s result;
+                result.ptr  = AllocateAligned( numBytes, alignment );
+                result.size = result.ptr ? GetBlockSize( result.ptr ) : 0;
+                return result;
+            }
+            // allocate a block of memory with tag rather than the calling thread's
+            // current memory tag. allocators that don't track tags ignore it
+            virtual void*   AllocateAligned( u32 numBytes, const align_t alignment, memtag_t tag )
+            {
+                ( void )tag;
+                return AllocateAligned( numBytes, alignment );
+            }
+            // free the block of memory associated with ptr. numBytes is the usable
+            // size AllocateAtLeast or GetBlockSize reported for the block, which
+            // allocators can use instead of looking the size up themselves
+            virtual void    Free( void* ptr, u32 numBytes )
+            {
+                ( void )numBytes;
+                Free( ptr );
+            }
         };
     }
 }
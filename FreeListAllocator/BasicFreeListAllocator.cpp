@@ -0,0 +1,9 @@
+#include "engine/memory/BasicFreeListAllocator.h"
+
+namespace bbengine
+{
+    namespace mem
+    {
+        thread_local oom_handler_scope_s* g_oomHandlerScopes = NULL;
+    }
+}
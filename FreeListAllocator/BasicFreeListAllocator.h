@@ -0,0 +1,262 @@
+#ifndef _BB_BASIC_FREELIST_ALLOCATOR_H_ // [ _BB_BASIC_FREELIST_ALLOCATOR_H_
+#define _BB_BASIC_FREELIST_ALLOCATOR_H_
+
+#include "engine/memory/Allocator.h"
+#include "engine/memory/FreeListPolicies.h"
+#include "engine/memory/FreeListBlockHeaders.h"
+#include "engine/memory/FreeListPages.h"
+#include "engine/memory/HeapImage.h"
+#include "engine/memory/LogHistogram.h"
+#include "engine/memory/MemoryTags.h"
+
+namespace bbengine
+{
+    namespace mem
+    {
+        // a single block, as reported to heap walk visitors
+        struct heap_block_info_s
+        {
+            void*   ptr;        // start of the block's usable memory
+            u32     size;       // usable size of the block
+            bool    isFree;
+            u32     tag;        // 0 for free and untagged blocks
+        };
+
+        // a failed allocation, as reported to out of memory handlers
+        struct out_of_memory_s
+        {
+            u32         numBytes;           // requested size
+            align_t     alignment;
+            memtag_t    tag;
+            u32         largestFreeBlock;   // usable size of the largest free block
+            u32         totalFreeBytes;     // usable bytes in all free blocks
+            u32         handlerIndex;       // position of the handler being called in the chain
+        };
+
+        // called when an allocation fails. the handler can free memory back
+        // to the allocator, ie by purging caches, and @return: true if the
+        // allocation should be tried again
+        typedef bool ( *out_of_memory_handler_t )( const out_of_memory_s& info, void* userData );
+
+        // an allocator whose out of memory handlers are running on the
+        // calling thread. each HandleOutOfMemory call pushes one onto the
+        // thread's list, so allocations that fail inside a handler don't
+        // call the handlers again, while other threads still can
+        struct oom_handler_scope_s
+        {
+            const void*             allocator;
+            oom_handler_scope_s*    next;
+        };
+
+        extern thread_local oom_handler_scope_s* g_oomHandlerScopes;
+
+        // Free list allocator built from policies. None of the methods are
+        // virtual so the allocation fast path can be inlined at the call
+        // site. Use FreeListAllocator where the Allocator interface is needed
+        template< class FitPolicy, class LockPolicy, class StatsPolicy, class DebugPolicy, class HeaderPolicy = DefaultBlockHeader, class PagePolicy = NullPagePolicy >
+        class BasicFreeListAllocator
+        {
+        public:
+            static_assert( !PagePolicy::RELEASES_FREE_SPACE || !DebugPolicy::CHECKS_FREE_SPACE,
+                           "DebugPolicy checks free space that PagePolicy gives back to the OS" );
+
+            typedef typename HeaderPolicy::block_s block_s;
+            typedef FitPolicy fit_t;
+            typedef LockPolicy lock_t;
+
+            static const u32 FREE_BIT_MASK          = 0x01u;
+            static const u32 ALIGNED_HEADER_SIZE    = ( sizeof( block_s ) + ( ALIGN_8 - 1 ) ) & ~( ALIGN_8 - 1 );
+            // an in use block's tag word holds its memtag_t, with the
+            // DebugPolicy's header canary in the bits above it
+            static const u32 CANARY_SHIFT           = sizeof( memtag_t ) * 8;
+            static const u32 MIN_ALLOC_SIZE         = ALIGNED_HEADER_SIZE + ALIGNED_HEADER_SIZE;
+            static const u32 MAX_OOM_HANDLERS       = 8;
+
+            // heapFlags are heap_flags_e. the heap comes from malloc when
+            // they are 0 or can't be met. with HEAP_RESERVE, heapSize is the
+            // most the heap can grow to
+            BasicFreeListAllocator( u32 heapSize, u32 heapFlags = 0 );
+            // takes over a heap mapped by LoadImage. it can't grow
+            explicit BasicFreeListAllocator( heap_image_s& image );
+            ~BasicFreeListAllocator( );
+
+            // writes the heap to an image that LoadImage can map back in,
+            // ie when cooking a level. pointers lists the addresses of every
+            // pointer inside the heap's blocks that points into the heap, so
+            // they can be moved when the image is loaded somewhere else.
+            // root is handed back by LoadImage. needs OffsetBlockHeader
+            // @return: false if the file could not be written
+            bool            SaveImage( const char* path, void* root, void* const* pointers, u32 numPointers );
+            // @return: false if the image can't be loaded, ie it was saved by
+            // an allocator with a different header size
+            static bool     LoadImage( const char* path, heap_image_s& image )  { return HeapImage_Load( path, ALIGNED_HEADER_SIZE, image ); }
+
+            void*           Allocate( u32 numBytes );
+            void*           AllocateAligned( u32 numBytes, const align_t alignment );
+            // tags the block with tag instead of the calling thread's current tag
+            void*           AllocateAligned( u32 numBytes, const align_t alignment, memtag_t tag );
+            allocation_s    AllocateAtLeast( u32 numBytes, const align_t alignment = ALIGN_8 );
+            void            Free( void* ptr );
+            // numBytes is the block's usable size, as AllocateAtLeast or
+            // GetBlockSize reported it, so the header's size isn't read
+            void            Free( void* ptr, u32 numBytes );
+            u32             GetBlockSize( void* ptr ) const;
+            memtag_t        GetBlockTag( void* ptr ) const;
+
+            // releases every block at once, returning the allocator to the
+            // state it was in after construction. checkLiveBlocks walks the
+            // heap first and fails a debug assertion if any blocks were
+            // still in use. @return: the blocks found in use, 0 unchecked
+            u32             Reset( bool checkLiveBlocks = false );
+
+            // counters kept by StatsPolicy. all zero with NullStatsPolicy.
+            // may walk the free list to find the largest free block again
+            heap_stats_s    GetStats( );
+
+            // cursor for a heap walk that is spread over several calls. the
+            // allocator keeps the cursor valid while blocks are allocated,
+            // freed and coalesced between calls
+            struct heap_walk_s
+            {
+                block_s*        block;  // next block to visit, NULL when done
+                heap_walk_s*    next;   // link in the list of walks in progress
+            };
+
+            // visits every block in physical order. in use blocks are not
+            // linked anywhere, so blocks are found by stepping over each
+            // block's size. visitor is called as visitor( const heap_block_info_s& )
+            // with the allocator locked, so it must not call back into it
+            template< class Visitor >
+            void            WalkHeap( Visitor& visitor );
+
+            // resumable walk that visits at most maxSteps blocks per call, so
+            // diagnostics can run a slice per frame. StepHeapWalk returns
+            // false once every block has been visited, at which point the
+            // walk is over. EndHeapWalk stops a walk early
+            void            BeginHeapWalk( heap_walk_s& walk );
+            template< class Visitor >
+            bool            StepHeapWalk( heap_walk_s& walk, u32 maxSteps, Visitor& visitor );
+            void            EndHeapWalk( heap_walk_s& walk );
+
+            // checks up to maxBlocks blocks of the heap for corruption,
+            // continuing where the last call left off and starting over once
+            // the whole heap has been checked, so a slice can run every frame.
+            // @return: false if corruption was found, with a description in
+            // error and the block it was found at in badBlock
+            bool            Verify( u32 maxBlocks, const char** error = NULL, void** badBlock = NULL );
+
+            // handlers are called in the order they were added when an
+            // allocation fails, and the allocation is retried after each
+            // handler that returns true. handlers are called without the
+            // allocator locked, so they can free to it, and on the thread
+            // whose allocation failed, so with a real LockPolicy they can run
+            // on several threads at once. allocations a handler makes that
+            // fail return NULL without calling the handlers again
+            // @return: false if MAX_OOM_HANDLERS are already added
+            bool            AddOutOfMemoryHandler( out_of_memory_handler_t handler, void* userData );
+            void            RemoveOutOfMemoryHandler( out_of_memory_handler_t handler, void* userData );
+
+            // gives back every whole page of free space that PagePolicy can,
+            // ignoring any thresholds it applies in Free. @return: bytes given back
+            u32             Trim( );
+
+            void*           GetHeapBase( ) const                    { return m_heap; }
+            // bytes of the heap in use as blocks. less than the reserved size
+            // until a HEAP_RESERVE heap has grown all the way
+            u32             GetHeapSize( ) const                    { return m_heapSize; }
+            u32             GetReservedSize( ) const                { return m_reservedSize; }
+            // huge pages backing the heap. see HeapPages_CountHuge
+            u32             GetHugePageCount( ) const               { return HeapPages_CountHuge( m_mapping ); }
+
+            // free list access for policies
+            block_s*        GetFirstFree( ) const                   { return m_firstFree; }
+            // the free block allocations are bumped off when FitPolicy sets
+            // USES_TOP_CHUNK, NULL otherwise or when there are no free blocks
+            block_s*        GetTopChunk( ) const                    { return m_top; }
+            block_s*        GetNext( const block_s* block ) const   { return HeaderPolicy::GetNext( ( byte* )m_heap, block ); }
+            static u32      GetSize( const block_s* block )         { return block->size & ~FREE_BIT_MASK; }
+            static bool     IsBlockFree( const block_s* block )     { return !( block->size & FREE_BIT_MASK ); }
+            static block_s* GetBlock( const void* ptr )             { return ( block_s* )( ( byte* )ptr - ALIGNED_HEADER_SIZE ); }
+            static void*    GetBlockData( const block_s* block )    { return ( byte* )block + ALIGNED_HEADER_SIZE; }
+            // tag and header canary of an in use block
+            static memtag_t GetTag( const block_s* block )          { return ( memtag_t )HeaderPolicy::GetTag( block ); }
+            static u32      GetHeaderCanary( const block_s* block ) { return HeaderPolicy::GetTag( block ) >> CANARY_SHIFT; }
+
+            FitPolicy&      GetFitPolicy( )                         { return m_fit; }
+            LockPolicy&     GetLockPolicy( )                        { return m_lock; }
+            StatsPolicy&    GetStatsPolicy( )                       { return m_stats; }
+            DebugPolicy&    GetDebugPolicy( )                       { return m_debug; }
+            PagePolicy&     GetPagePolicy( )                        { return m_pages; }
+
+        private:
+
+            BasicFreeListAllocator( BasicFreeListAllocator& );
+
+            void            InitState( );
+            void            InitFreeList( );
+            void            RestoreBlocks( );
+            block_s*        GetFirstBlock( ) const;
+            u32             CountLiveBlocks( ) const;
+            block_s*        GetNextPhysical( const block_s* block ) const;
+            void            FixupHeapWalks( const block_s* absorbed, const block_s* into );
+            void            UnlinkHeapWalk( heap_walk_s& walk );
+            void            EndVerify( );
+            void*           TryAllocate( u32 numBytes, const align_t alignment, memtag_t tag, u32& blocksVisited );
+            block_s*        BumpTopChunk( u32 sizeNeeded );
+            void*           TryAllocateOrGrow( u32 numBytes, const align_t alignment, memtag_t tag, u32& blocksVisited );
+            bool            Grow( u32 sizeNeeded );
+            void            FreeBlock( block_s* block, u32 blockSize, u64 startTime );
+            bool            IsIntactBlock( const block_s* block, u32 blockSize ) const;
+            u32             InsertFreeBlock( block_s* block );
+            static u32      GetSizeNeeded( u32 numBytes, const align_t alignment );
+            void*           HandleOutOfMemory( u32 numBytes, const align_t alignment, memtag_t tag, u32& blocksVisited );
+            void            GetFreeSpace( u32& largestFreeBlock, u32& totalFreeBytes ) const;
+            void            SetNext( block_s* block, block_s* next ) { HeaderPolicy::SetNext( ( byte* )m_heap, block, next ); }
+
+            void*           m_heap;         // ptr to internal memory used for allocations
+            u32             m_heapSize;     // size in bytes of m_heap that is committed
+            u32             m_reservedSize; // size in bytes m_heap can grow to
+            heap_mapping_s  m_mapping;      // m_heap if it was mapped rather than malloc'd
+            block_s*        m_firstFree;    // head of list of address-ordered free blocks
+            block_s*        m_top;          // free block allocations are bumped off, only kept for FitPolicy::USES_TOP_CHUNK
+            heap_walk_s*    m_heapWalks;    // heap walks in progress
+            u32             m_epoch;        // changes whenever a block is allocated or freed
+            bool            m_uncheckedCanaries;    // restored from an image without header canaries, so
+                                                    // blocks without one are accepted until reallocated
+
+            // state of Verify between calls. checks that span calls are
+            // only made when m_epoch hasn't changed in between
+            struct verify_s
+            {
+                heap_walk_s     walk;
+                block_s*        expectedFree;   // next free block the free list says is coming
+                bool            active;         // walk is in progress
+                bool            chainKnown;     // expectedFree can be trusted
+                bool            prevFree;       // block before walk.block is free
+                u32             epoch;          // m_epoch at the end of the last call
+            };
+
+            verify_s        m_verify;
+
+            struct oom_handler_s
+            {
+                out_of_memory_handler_t handler;
+                void*                   userData;
+            };
+
+            oom_handler_s   m_oomHandlers[ MAX_OOM_HANDLERS ];
+            u32             m_numOomHandlers;
+
+            FitPolicy       m_fit;
+            LockPolicy      m_lock;
+            StatsPolicy     m_stats;
+            DebugPolicy     m_debug;
+            PagePolicy      m_pages;
+        };
+    }
+}
+
+#include "engine/memory/BasicFreeListAllocator.inl"
+
+
+#endif // ] _BB_BASIC_FREELIST_ALLOCATOR_H_
@@ -0,0 +1,1477 @@
+#include "engine/system/Assert.h"
+#include <stdlib.h>
+#include <string.h>
+#include <type_traits>
+
+namespace bbengine
+{
+    namespace mem
+    {
+        #define FREELIST_TEMPLATE   template< class FitPolicy, class LockPolicy, class StatsPolicy, class DebugPolicy, class HeaderPolicy, class PagePolicy >
+        #define FREELIST_CLASS      BasicFreeListAllocator< FitPolicy, LockPolicy, StatsPolicy, DebugPolicy, HeaderPolicy, PagePolicy >
+
+
+        /*====================================================================
+
+            BasicFreeListAllocator::BasicFreeListAllocator( u32 heapSize, u32 heapFlags )
+            - allocates memory buffer based on heapSize, mapping it as
+              heapFlags asks if possible and falling back to malloc
+            - a reserved heap starts out with only its first pages committed
+            - initializes internal free list
+
+            TODO:
+            - Allocate internal memory block from a parent custom allocator
+              instead of using malloc and free
+
+        ====================================================================*/
+        FREELIST_TEMPLATE
+        FREELIST_CLASS::BasicFreeListAllocator( u32 heapSize, u32 heapFlags )
+        {
+            m_heap = HeapPages_Map( heapSize, heapFlags, m_mapping ) ? m_mapping.base : malloc( heapSize );
+            m_heapSize = heapSize;
+            m_reservedSize = heapSize;
+
+            if( m_mapping.base && m_mapping.committed < m_mapping.size )
+            {
+                // reserved. the heap can grow into the whole mapping, which is
+                // heapSize rounded up to a page
+                m_heapSize = ( u32 )m_mapping.committed;
+                m_reservedSize = m_mapping.size < 0xFFFFFFFFull ? ( u32 )m_mapping.size : 0xFFFFFFFFu;
+            }
+            InitState();
+
+            m_debug.OnInit( m_heap, m_reservedSize );
+            m_debug.OnCommit( m_heap, m_heapSize );
+            m_pages.OnInit( m_heap, m_reservedSize );
+
+            InitFreeList();
+        }
+
+
+        /*====================================================================
+
+            BasicFreeListAllocator::BasicFreeListAllocator( heap_image_s& image )
+            - takes over the mapping of a loaded heap image, leaving image
+              without one
+            - the blocks in the image are reported to the policies as if
+              they had just been allocated or freed, without their memory
+              being touched
+            - if DebugPolicy checks header canaries and the image was saved
+              without them, blocks with no canary are accepted unchecked.
+              a block gets its canary when it is next allocated, so no
+              header is written on load
+
+        ====================================================================*/
+        FREELIST_TEMPLATE
+        FREELIST_CLASS::BasicFreeListAllocator( heap_image_s& image )
+        {
+            static_assert( std::is_same< HeaderPolicy, OffsetBlockHeader >::value, "Heap images need OffsetBlockHeader" );
+
+            m_mapping = image.mapping;
+            image.mapping.base = NULL;
+
+            m_heap = image.heap;
+            m_heapSize = image.heapSize;
+            m_reservedSize = image.heapSize;
+            m_firstFree = image.firstFree == HEAP_IMAGE_NO_OFFSET ? NULL : ( block_s* )( ( byte* )m_heap + image.firstFree );
+            m_top = NULL;
+
+            InitState();
+
+            m_uncheckedCanaries = DebugPolicy::USES_HEADER_CANARY && !( image.flags & HEAP_IMAGE_BLOCK_CANARIES );
+
+            m_debug.OnInit( m_heap, m_heapSize );
+            m_debug.OnRestore( m_heap, m_heapSize );
+            m_pages.OnInit( m_heap, m_heapSize );
+
+            RestoreBlocks();
+        }
+
+
+        /*====================================================================
+
+            BasicFreeListAllocator::~BasicFreeListAllocator
+            - releases memory held by internal buffer
+
+        ====================================================================*/
+        FREELIST_TEMPLATE
+        FREELIST_CLASS::~BasicFreeListAllocator()
+        {
+            m_debug.OnRelease();
+            m_pages.OnRelease();
+
+            if( m_mapping.base )
+            {
+                HeapPages_Unmap( m_mapping );
+            }
+            else
+            {
+                free( m_heap );
+            }
+
+            m_heap = NULL;
+        }
+
+
+        /*====================================================================
+
+            BasicFreeListAllocator::InitState
+            - clears everything that isn't part of the heap itself
+
+        ====================================================================*/
+        FREELIST_TEMPLATE
+        void FREELIST_CLASS::InitState( )
+        {
+            m_heapWalks = NULL;
+            m_epoch = 0;
+            m_verify.active = false;
+            m_numOomHandlers = 0;
+            m_uncheckedCanaries = false;
+        }
+
+
+        /*====================================================================
+
+            BasicFreeListAllocator::RestoreBlocks
+            - walks a heap loaded from an image, telling the stats, debug
+              and page policies about each block. the largest free block
+              becomes the top chunk
+
+        ====================================================================*/
+        FREELIST_TEMPLATE
+        void FREELIST_CLASS::RestoreBlocks( )
+        {
+            for( block_s* block = GetFirstBlock(); block; block = GetNextPhysical( block ) )
+            {
+                if( IsBlockFree( block ) )
+                {
+                    if( FitPolicy::USES_TOP_CHUNK && ( m_top == NULL || m_top->size < block->size ) )
+                    {
+                        m_top = block;
+                    }
+
+                    m_stats.OnFreeBlockAdded( block->size );
+                    m_debug.OnFreeSpace( GetBlockData( block ), block->size );
+                    m_pages.OnFreeSpace( GetBlockData( block ), block->size );
+                }
+                else
+                {
+                    m_stats.OnAllocate( GetBlockData( block ), GetSize( block ), GetTag( block ) );
+                    m_debug.OnRestoreBlock( GetBlockData( block ), GetSize( block ) );
+                }
+            }
+        }
+
+
+        /*====================================================================
+
+            BasicFreeListAllocator::SaveImage( const char* path, void* root, void* const* pointers, u32 numPointers )
+            - writes the heap as it is, with the free list head, root and
+              pointers as offsets from the start of the heap
+            - free space is unprotected while it is written, for debug
+              policies that protect it
+
+        ====================================================================*/
+        FREELIST_TEMPLATE
+        bool FREELIST_CLASS::SaveImage( const char* path, void* root, void* const* pointers, u32 numPointers )
+        {
+            static_assert( std::is_same< HeaderPolicy, OffsetBlockHeader >::value, "Heap images need OffsetBlockHeader" );
+
+            ScopedPolicyLock< LockPolicy > lock( m_lock );
+
+            u32* pointerOffsets = ( u32* )malloc( sizeof( u32 ) * ( numPointers ? numPointers : 1 ) );
+
+            if( pointerOffsets == NULL )
+            {
+                return false;
+            }
+
+            u32 numOffsets = 0;
+
+            for( u32 i = 0; i < numPointers; ++i )
+            {
+                size_t offset = ( size_t )( ( byte* )pointers[ i ] - ( byte* )m_heap );
+
+                if( offset > m_heapSize - sizeof( void* ) )
+                {
+                    DEBUG_ASSERT( false && "Heap image pointer is not inside the heap" );
+                    continue;
+                }
+
+                pointerOffsets[ numOffsets++ ] = ( u32 )offset;
+            }
+
+            heap_image_header_s header;
+            header.magic = HEAP_IMAGE_MAGIC;
+            header.version = HEAP_IMAGE_VERSION;
+            header.blockHeaderSize = ALIGNED_HEADER_SIZE;
+            header.heapSize = m_heapSize;
+            header.firstFree = m_firstFree ? ( u32 )( ( byte* )m_firstFree - ( byte* )m_heap ) : HEAP_IMAGE_NO_OFFSET;
+            header.root = root ? ( u32 )( ( byte* )root - ( byte* )m_heap ) : HEAP_IMAGE_NO_OFFSET;
+            header.numPointers = numOffsets;
+            header.dataOffset = ( sizeof( header ) + sizeof( u32 ) * numOffsets + HEAP_IMAGE_ALIGNMENT - 1 ) & ~( HEAP_IMAGE_ALIGNMENT - 1 );
+            // blocks restored unchecked still have no canary
+            header.flags = DebugPolicy::USES_HEADER_CANARY && !m_uncheckedCanaries ? HEAP_IMAGE_BLOCK_CANARIES : 0;
+            header.reserved = 0;
+            header.savedBase = ( u64 )( size_t )m_heap;
+
+            m_debug.OnRelease();
+
+            bool ok = HeapImage_Write( path, header, pointerOffsets, m_heap );
+
+            for( block_s* block = m_firstFree; block; block = GetNext( block ) )
+            {
+                m_debug.OnFreeSpace( GetBlockData( block ), block->size );
+            }
+
+            free( pointerOffsets );
+
+            return ok;
+        }
+
+
+        /*====================================================================
+
+            BasicFreeListAllocator::GetFirstBlock
+            - @return: the physically first block in the heap, which is the
+              first 8-byte aligned address in m_heap
+
+        ====================================================================*/
+        FREELIST_TEMPLATE
+        typename FREELIST_CLASS::block_s* FREELIST_CLASS::GetFirstBlock( ) const
+        {
+            size_t misalignment = ( size_t )m_heap & ( ALIGN_8 - 1 );
+            size_t padding = misalignment ? ALIGN_8 - misalignment : 0;
+
+            return ( block_s* )( ( byte* )m_heap + padding );
+        }
+
+
+        /*====================================================================
+
+            BasicFreeListAllocator::InitFreeList
+            - sets up the free list as a single free block spanning the
+              whole heap, which is also the top chunk when FitPolicy
+              uses one
+
+        ====================================================================*/
+        FREELIST_TEMPLATE
+        void FREELIST_CLASS::InitFreeList( )
+        {
+            m_firstFree = GetFirstBlock();
+            SetNext( m_firstFree, NULL );
+            m_top = FitPolicy::USES_TOP_CHUNK ? m_firstFree : NULL;
+            m_firstFree->size = m_heapSize - ALIGNED_HEADER_SIZE -
+                                ( u32 )( ( byte* )m_firstFree - ( byte* )m_heap );
+
+            m_stats.OnFreeBlockAdded( m_firstFree->size );
+            m_debug.OnFreeSpace( GetBlockData( m_firstFree ), m_firstFree->size );
+        }
+
+
+        /*====================================================================
+
+            BasicFreeListAllocator::Reset( bool checkLiveBlocks )
+            - releases every allocation in constant time by rebuilding the
+              free list as a single block spanning the heap
+            - any pointers into the heap are invalid after the reset
+            - if checkLiveBlocks is set, the heap is walked first and debug
+              builds fail an assertion if any blocks are still in use. the
+              walk is the only part that isn't constant time
+            - @return: number of blocks that were still in use, 0 if
+              checkLiveBlocks isn't set
+
+        ====================================================================*/
+        FREELIST_TEMPLATE
+        u32 FREELIST_CLASS::Reset( bool checkLiveBlocks )
+        {
+            ScopedPolicyLock< LockPolicy > lock( m_lock );
+
+            u32 liveBlocks = checkLiveBlocks ? CountLiveBlocks() : 0;
+            DEBUG_ASSERT( liveBlocks == 0 && "Resetting allocator with blocks still in use" );
+
+            m_stats.OnReset();
+            m_debug.OnReset();
+            m_fit.OnReset();
+
+            InitFreeList();
+            ++m_epoch;
+            m_uncheckedCanaries = false;
+
+            // walks in progress have nothing left to visit
+            for( heap_walk_s* walk = m_heapWalks; walk; walk = walk->next )
+            {
+                walk->block = NULL;
+            }
+
+            return liveBlocks;
+        }
+
+
+        /*====================================================================
+
+            BasicFreeListAllocator::CountLiveBlocks
+            - walks the heap by physical adjacency, since in use blocks are
+              not linked anywhere
+            - @return: number of blocks currently in use
+
+        ====================================================================*/
+        FREELIST_TEMPLATE
+        u32 FREELIST_CLASS::CountLiveBlocks( ) const
+        {
+            u32 liveBlocks = 0;
+
+            byte* heapEnd = ( byte* )m_heap + m_heapSize;
+            block_s* block = GetFirstBlock();
+
+            while( ( byte* )block < heapEnd )
+            {
+                if( !IsBlockFree( block ) )
+                {
+                    ++liveBlocks;
+                }
+
+                block = ( block_s* )( ( byte* )block + ALIGNED_HEADER_SIZE + GetSize( block ) );
+            }
+
+            return liveBlocks;
+        }
+
+
+        /*====================================================================
+
+            BasicFreeListAllocator::GetNextPhysical
+            - @return: the block directly after block in memory, or NULL if
+              block is the last block in the heap
+
+        ====================================================================*/
+        FREELIST_TEMPLATE
+        inline typename FREELIST_CLASS::block_s* FREELIST_CLASS::GetNextPhysical( const block_s* block ) const
+        {
+            byte* next = ( byte* )block + ALIGNED_HEADER_SIZE + GetSize( block );
+
+            return next < ( byte* )m_heap + m_heapSize ? ( block_s* )next : NULL;
+        }
+
+
+        /*====================================================================
+
+            BasicFreeListAllocator::WalkHeap( Visitor& visitor )
+            - calls visitor for every block in the heap, in address order
+
+        ====================================================================*/
+        FREELIST_TEMPLATE
+        template< class Visitor >
+        void FREELIST_CLASS::WalkHeap( Visitor& visitor )
+        {
+            heap_walk_s walk;
+            BeginHeapWalk( walk );
+
+            while( StepHeapWalk( walk, 0xFFFFFFFFu, visitor ) )
+            {
+            }
+        }
+
+
+        /*====================================================================
+
+            BasicFreeListAllocator::BeginHeapWalk( heap_walk_s& walk )
+            - starts a resumable walk at the first block in the heap
+            - walk is tracked by the allocator until StepHeapWalk returns
+              false or EndHeapWalk is called, and must stay alive until then
+
+        ====================================================================*/
+        FREELIST_TEMPLATE
+        void FREELIST_CLASS::BeginHeapWalk( heap_walk_s& walk )
+        {
+            ScopedPolicyLock< LockPolicy > lock( m_lock );
+
+            walk.block = GetFirstBlock();
+            walk.next = m_heapWalks;
+            m_heapWalks = &walk;
+        }
+
+
+        /*====================================================================
+
+            BasicFreeListAllocator::StepHeapWalk( heap_walk_s& walk, u32 maxSteps, Visitor& visitor )
+            - visits up to maxSteps blocks, continuing where the last call
+              left off. the walk sees the heap as it is at each step, so
+              blocks allocated or freed between calls may be reported in
+              either state
+            - @return: true if there are blocks left to visit
+
+        ====================================================================*/
+        FREELIST_TEMPLATE
+        template< class Visitor >
+        bool FREELIST_CLASS::StepHeapWalk( heap_walk_s& walk, u32 maxSteps, Visitor& visitor )
+        {
+            ScopedPolicyLock< LockPolicy > lock( m_lock );
+
+            for( u32 step = 0; walk.block && step < maxSteps; ++step )
+            {
+                heap_block_info_s info;
+                info.ptr = GetBlockData( walk.block );
+                info.size = GetSize( walk.block );
+                info.isFree = IsBlockFree( walk.block );
+                info.tag = info.isFree ? MEM_TAG_NONE : GetTag( walk.block );
+
+                walk.block = GetNextPhysical( walk.block );
+
+                visitor( info );
+            }
+
+            if( walk.block == NULL )
+            {
+                UnlinkHeapWalk( walk );
+                return false;
+            }
+
+            return true;
+        }
+
+
+        /*====================================================================
+
+            BasicFreeListAllocator::EndHeapWalk( heap_walk_s& walk )
+            - stops tracking a walk that has not finished
+
+        ====================================================================*/
+        FREELIST_TEMPLATE
+        void FREELIST_CLASS::EndHeapWalk( heap_walk_s& walk )
+        {
+            ScopedPolicyLock< LockPolicy > lock( m_lock );
+
+            UnlinkHeapWalk( walk );
+            walk.block = NULL;
+        }
+
+
+        /*====================================================================
+
+            BasicFreeListAllocator::UnlinkHeapWalk( heap_walk_s& walk )
+            - removes walk from the list of walks in progress, if it is in it
+
+        ====================================================================*/
+        FREELIST_TEMPLATE
+        void FREELIST_CLASS::UnlinkHeapWalk( heap_walk_s& walk )
+        {
+            for( heap_walk_s** link = &m_heapWalks; *link; link = &( *link )->next )
+            {
+                if( *link == &walk )
+                {
+                    *link = walk.next;
+                    break;
+                }
+            }
+
+            walk.next = NULL;
+        }
+
+
+        /*====================================================================
+
+            BasicFreeListAllocator::Verify( u32 maxBlocks, const char** error, void** badBlock )
+            - walks up to maxBlocks blocks in physical order, checking that:
+              - every block ends inside the heap and the last block ends
+                exactly at the end of the heap, so block sizes add up to
+                the heap size
+              - no two free blocks are next to each other
+              - the free list visits exactly the blocks whose free bit is
+                clear, in address order, starting at m_firstFree
+              - the top chunk, if there is one, is not a block in use
+            - the walk is a heap_walk_s, so it stays on a block boundary
+              while the heap changes between calls. when the heap has
+              changed, the free list is picked up again at the next free
+              block instead of being followed from the last one
+            - @return: false if corruption was found. the walk starts over
+              on the next call
+
+        ====================================================================*/
+        FREELIST_TEMPLATE
+        bool FREELIST_CLASS::Verify( u32 maxBlocks, const char** error, void** badBlock )
+        {
+            ScopedPolicyLock< LockPolicy > lock( m_lock );
+
+            verify_s& verify = m_verify;
+
+            if( !verify.active )
+            {
+                verify.walk.block = GetFirstBlock();
+                verify.walk.next = m_heapWalks;
+                m_heapWalks = &verify.walk;
+
+                verify.expectedFree = m_firstFree;
+                verify.active = true;
+                verify.chainKnown = true;
+                verify.prevFree = false;
+            }
+            else if( verify.epoch != m_epoch )
+            {
+                verify.chainKnown = false;
+                verify.prevFree = false;
+            }
+
+            byte* heapEnd = ( byte* )m_heap + m_heapSize;
+            block_s* block = verify.walk.block;
+            const char* problem = NULL;
+
+            for( u32 step = 0; block && step < maxBlocks; ++step )
+            {
+                byte* blockEnd = ( byte* )block + ALIGNED_HEADER_SIZE + GetSize( block );
+
+                if( blockEnd > heapEnd )
+                {
+                    problem = "Block extends past the end of the heap";
+                    break;
+                }
+
+                bool isFree = IsBlockFree( block );
+
+                if( isFree )
+                {
+                    if( verify.prevFree )
+                    {
+                        problem = "Adjacent free blocks were not coalesced";
+                        break;
+                    }
+
+                    if( verify.chainKnown && block != verify.expectedFree )
+                    {
+                        problem = verify.expectedFree == NULL || block < verify.expectedFree ?
+                                  "Free block is missing from the free list" : "Free list points inside a block";
+                        break;
+                    }
+
+                    block_s* nextFree = GetNext( block );
+
+                    if( nextFree && ( nextFree <= block || ( byte* )nextFree >= heapEnd ) )
+                    {
+                        problem = "Free list is out of address order";
+                        break;
+                    }
+
+                    verify.expectedFree = nextFree;
+                    verify.chainKnown = true;
+                }
+                else if( verify.chainKnown && block == verify.expectedFree )
+                {
+                    problem = "Free list contains a block in use";
+                    break;
+                }
+                else if( block == m_top )
+                {
+                    problem = "Top chunk is a block in use";
+                    break;
+                }
+
+                verify.prevFree = isFree;
+                block = blockEnd < heapEnd ? ( block_s* )blockEnd : NULL;
+            }
+
+            if( problem == NULL && block == NULL && verify.chainKnown && verify.expectedFree )
+            {
+                problem = "Free list continues past the last free block";
+            }
+
+            if( error )
+            {
+                *error = problem;
+            }
+
+            if( badBlock )
+            {
+                *badBlock = problem ? block : NULL;
+            }
+
+            verify.walk.block = block;
+            verify.epoch = m_epoch;
+
+            if( problem || block == NULL )
+            {
+                EndVerify();
+            }
+
+            return problem == NULL;
+        }
+
+
+        /*====================================================================
+
+            BasicFreeListAllocator::EndVerify
+            - finishes the current Verify walk, so the next call starts over
+
+        ====================================================================*/
+        FREELIST_TEMPLATE
+        void FREELIST_CLASS::EndVerify( )
+        {
+            UnlinkHeapWalk( m_verify.walk );
+            m_verify.active = false;
+        }
+
+
+        /*====================================================================
+
+            BasicFreeListAllocator::FixupHeapWalks
+            - called when coalescing absorbs a block's header into the block
+              before it. walks that were about to visit the absorbed block
+              move on to the block after the joined one, since the memory
+              is now part of a block they have already visited
+
+        ====================================================================*/
+        FREELIST_TEMPLATE
+        void FREELIST_CLASS::FixupHeapWalks( const block_s* absorbed, const block_s* into )
+        {
+            for( heap_walk_s* walk = m_heapWalks; walk; walk = walk->next )
+            {
+                if( walk->block == absorbed )
+                {
+                    walk->block = GetNextPhysical( into );
+                }
+            }
+        }
+
+
+        /*====================================================================
+
+            BasicFreeListAllocator::Allocate( u32 numBytes)
+            - Allocate 8-byte aligned memory of numBytes size.
+            - @return: returns pointer to memory aligned block
+
+        ====================================================================*/
+        FREELIST_TEMPLATE
+        inline void* FREELIST_CLASS::Allocate( u32 numBytes )
+        {
+            return AllocateAligned( numBytes, ALIGN_8 );
+        }
+
+
+        /*====================================================================
+
+            BasicFreeListAllocator::AllocateAligned( u32 numBytes, const align_t alignment)
+            - Allocate aligned memory of numBytes size, tagged with the
+              calling thread's current memory tag
+            - @return: returns pointer to memory aligned block
+
+        ====================================================================*/
+        FREELIST_TEMPLATE
+        inline void* FREELIST_CLASS::AllocateAligned( u32 numBytes, const align_t alignment )
+        {
+            return AllocateAligned( numBytes, alignment, MemTag_GetCurrent() );
+        }
+
+
+        /*====================================================================
+
+            BasicFreeListAllocator::AllocateAligned( u32 numBytes, const align_t alignment, memtag_t tag )
+            - Allocate aligned memory of numBytes size.
+            - tag is kept in the block header until the block is freed
+            - if there is no free block large enough, a reserved heap grows to
+              make room. failing that, the out of memory handlers get a
+              chance to free some memory
+            - StatsPolicy is told once how the call ended, however many
+              attempts it took, with the blocks looked at by all of them
+            - @return: returns pointer to memory aligned block
+
+        ====================================================================*/
+        FREELIST_TEMPLATE
+        inline void* FREELIST_CLASS::AllocateAligned( u32 numBytes, const align_t alignment, memtag_t tag )
+        {
+            u64 startTime = StatsPolicy::TIMED_OPERATIONS ? ReadCycleCounter() : 0;
+            u32 blocksVisited = 0;
+
+            {
+                ScopedPolicyLock< LockPolicy > lock( m_lock );
+
+                void* ret = TryAllocateOrGrow( numBytes, alignment, tag, blocksVisited );
+
+                if( ret )
+                {
+                    m_stats.OnAllocateDone( startTime, numBytes, alignment, ret, tag, blocksVisited );
+                    return ret;
+                }
+            }
+
+            void* ret = HandleOutOfMemory( numBytes, alignment, tag, blocksVisited );
+
+            ScopedPolicyLock< LockPolicy > lock( m_lock );
+            m_stats.OnAllocateDone( startTime, numBytes, alignment, ret, tag, blocksVisited );
+
+            return ret;
+        }
+
+
+        /*====================================================================
+
+            BasicFreeListAllocator::TryAllocate( u32 numBytes, const align_t alignment, memtag_t tag, u32& blocksVisited )
+            - one attempt at an allocation, made with the lock held. the
+              free block to allocate from is chosen by FitPolicy
+            - adds the number of free blocks looked at to blocksVisited
+            - @return: pointer to memory aligned block, NULL if no free block
+              is large enough
+
+        ====================================================================*/
+        FREELIST_TEMPLATE
+        inline void* FREELIST_CLASS::TryAllocate( u32 numBytes, const align_t alignment, memtag_t tag, u32& blocksVisited )
+        {
+            u32 sizeNeeded = GetSizeNeeded( numBytes, alignment );
+
+            block_s* prevBlock = NULL;
+            block_s* block = m_fit.FindBlock( *this, sizeNeeded, prevBlock, blocksVisited );
+
+            if( block == NULL )
+            {
+                // No blocks large enough to fit memory request
+                return NULL;
+            }
+
+            DEBUG_ASSERT( IsBlockFree( block ) && "Trying to allocate from a block of memory that is already in use" );
+
+            if( FitPolicy::USES_TOP_CHUNK && block == m_top )
+            {
+                block = BumpTopChunk( sizeNeeded );
+            }
+            else
+            {
+                m_stats.OnFreeBlockRemoved( block->size );
+
+                bool split = sizeNeeded + MIN_ALLOC_SIZE <= block->size;
+
+                // the block's memory, and the header of the block split off after
+                // it, are about to be written to
+                m_debug.OnReuseFreeSpace( GetBlockData( block ), split ? sizeNeeded : block->size );
+                m_pages.OnReuseFreeSpace( GetBlockData( block ), split ? sizeNeeded : block->size );
+
+                // check to see if another allocation can be made after this one
+                if( split )
+                {
+                    // split the free block
+                    block_s* newBlock = ( block_s* )( ( byte* )block + sizeNeeded );
+                    // link the new free block into the free list
+                    SetNext( newBlock, GetNext( block ) );
+                    newBlock->size = block->size - sizeNeeded;
+
+                    // begin removing block from the free list. this is half of it,
+                    // need prevBlock for the other half of the removal process
+                    SetNext( block, newBlock );
+                    // update the size of the block, taking into account the number
+                    // of bytes needed for the header of the block
+                    block->size = sizeNeeded - ALIGNED_HEADER_SIZE;
+
+                    m_stats.OnFreeBlockAdded( newBlock->size );
+                }
+
+                if( prevBlock )
+                {
+                    // complete inserting any new blocks into the free list and
+                    // remove the current block from the free list
+                    SetNext( prevBlock, GetNext( block ) );
+                }
+                else
+                {
+                    // if a previous block wasnt found bound on memory address, then
+                    // the first free block was grabbed from the list and the head
+                    // of the list now needs to be updated
+                    m_firstFree = GetNext( m_firstFree );
+                }
+            }
+
+            void* ret = GetBlockData( block );
+
+            // in use blocks aren't linked, so the next field holds the tag
+            // and the header canary
+            HeaderPolicy::SetTag( block, tag | ( m_debug.GetHeaderCanary( ret, block->size ) << CANARY_SHIFT ) );
+            ++m_epoch;
+
+            // flag the block as being used
+            block->size |= FREE_BIT_MASK;
+
+            m_stats.OnAllocate( ret, GetSize( block ), tag );
+            m_debug.OnAllocate( ret, GetSize( block ) );
+
+            return ret;
+        }
+
+
+        /*====================================================================
+
+            BasicFreeListAllocator::BumpTopChunk( u32 sizeNeeded )
+            - carves a block of sizeNeeded, header included, off the end of
+              the top chunk. the top chunk stays in the free list however
+              small it gets, even with no usable bytes left, so it never
+              needs the block in front of it
+            - @return: the new block, still marked free
+
+        ====================================================================*/
+        FREELIST_TEMPLATE
+        inline typename FREELIST_CLASS::block_s* FREELIST_CLASS::BumpTopChunk( u32 sizeNeeded )
+        {
+            DEBUG_ASSERT( sizeNeeded <= m_top->size && "Top chunk is too small to bump" );
+
+            m_stats.OnFreeBlockRemoved( m_top->size );
+
+            m_top->size -= sizeNeeded;
+            block_s* block = ( block_s* )( ( byte* )GetBlockData( m_top ) + m_top->size );
+
+            m_stats.OnFreeBlockAdded( m_top->size );
+
+            // the block's header and memory are about to be written to
+            m_debug.OnReuseFreeSpace( block, sizeNeeded );
+            m_pages.OnReuseFreeSpace( block, sizeNeeded );
+
+            block->size = sizeNeeded - ALIGNED_HEADER_SIZE;
+
+            return block;
+        }
+
+
+        /*====================================================================
+
+            BasicFreeListAllocator::GetSizeNeeded( u32 numBytes, const align_t alignment )
+            - @return: bytes a free block needs for an allocation of
+              numBytes, including the header of the block
+
+        ====================================================================*/
+        FREELIST_TEMPLATE
+        inline u32 FREELIST_CLASS::GetSizeNeeded( u32 numBytes, const align_t alignment )
+        {
+            u32 sizeNeeded = numBytes;
+
+            // make sure allocation is at least the size of block header.
+            // should be using another allocator ( ie SlabAllocator ) for
+            // smaller allocations.
+            if( sizeNeeded < ALIGNED_HEADER_SIZE )
+            {
+                sizeNeeded = ALIGNED_HEADER_SIZE;
+            }
+
+            // make sure the requested allocation size is aligned and at
+            // least 8 bytes + the aligned size of the block header
+            return MemUtils_Align( sizeNeeded, alignment ) + ALIGNED_HEADER_SIZE;
+        }
+
+
+        /*====================================================================
+
+            BasicFreeListAllocator::Grow( u32 sizeNeeded )
+            - commits more of a reserved heap, enough for a free block of
+              sizeNeeded, and frees it into the free list. it coalesces with
+              the last block of the heap if that block is free, so the heap
+              stays a single range of blocks
+            - called with the lock held
+            - @return: false if the heap can't grow
+
+        ====================================================================*/
+        FREELIST_TEMPLATE
+        bool FREELIST_CLASS::Grow( u32 sizeNeeded )
+        {
+            u64 committed = m_mapping.committed;
+
+            // free blocks are sized without their header, and FitPolicy
+            // compares their size against sizeNeeded
+            if( !HeapPages_Commit( m_mapping, sizeNeeded + ALIGNED_HEADER_SIZE ) )
+            {
+                return false;
+            }
+
+            u32 growth = ( u32 )( m_mapping.committed - committed );
+            block_s* block = ( block_s* )( ( byte* )m_heap + m_heapSize );
+
+            m_debug.OnCommit( block, growth );
+
+            m_heapSize += growth;
+            ++m_epoch;
+
+            block->size = growth - ALIGNED_HEADER_SIZE;
+            SetNext( block, NULL );
+
+            InsertFreeBlock( block );
+
+            return true;
+        }
+
+
+        /*====================================================================
+
+            BasicFreeListAllocator::TryAllocateOrGrow( u32 numBytes, const align_t alignment, memtag_t tag, u32& blocksVisited )
+            - the whole allocation path short of the out of memory handlers,
+              made with the lock held. if no free block is large enough, a
+              reserved heap grows to make room and the allocation is tried
+              again
+            - @return: pointer to memory aligned block, NULL if it still fails
+
+        ====================================================================*/
+        FREELIST_TEMPLATE
+        inline void* FREELIST_CLASS::TryAllocateOrGrow( u32 numBytes, const align_t alignment, memtag_t tag, u32& blocksVisited )
+        {
+            void* ret = TryAllocate( numBytes, alignment, tag, blocksVisited );
+
+            if( ret == NULL && m_heapSize < m_reservedSize && Grow( GetSizeNeeded( numBytes, alignment ) ) )
+            {
+                ret = TryAllocate( numBytes, alignment, tag, blocksVisited );
+            }
+
+            return ret;
+        }
+
+
+        /*====================================================================
+
+            BasicFreeListAllocator::HandleOutOfMemory( u32 numBytes, const align_t alignment, memtag_t tag, u32& blocksVisited )
+            - calls each out of memory handler in turn with the failed
+              request and the current state of the free list, retrying the
+              allocation, growing the heap if need be, after every handler
+              that asks for it
+            - the handlers are copied under the lock and called without it,
+              so they can free to the allocator and add or remove handlers
+            - a failure inside one of this allocator's handlers on the same
+              thread returns NULL straight away instead of recursing
+            - @return: pointer to memory aligned block, NULL if every handler
+              has been called and the allocation still fails
+
+        ====================================================================*/
+        FREELIST_TEMPLATE
+        void* FREELIST_CLASS::HandleOutOfMemory( u32 numBytes, const align_t alignment, memtag_t tag, u32& blocksVisited )
+        {
+            for( oom_handler_scope_s* scope = g_oomHandlerScopes; scope; scope = scope->next )
+            {
+                if( scope->allocator == this )
+                {
+                    return NULL;
+                }
+            }
+
+            oom_handler_s handlers[ MAX_OOM_HANDLERS ];
+            u32 numHandlers;
+
+            {
+                ScopedPolicyLock< LockPolicy > lock( m_lock );
+
+                if( m_numOomHandlers == 0 )
+                {
+                    return NULL;
+                }
+
+                numHandlers = m_numOomHandlers;
+                memcpy( handlers, m_oomHandlers, sizeof( oom_handler_s ) * numHandlers );
+            }
+
+            oom_handler_scope_s scope;
+            scope.allocator = this;
+            scope.next = g_oomHandlerScopes;
+            g_oomHandlerScopes = &scope;
+
+            out_of_memory_s info;
+            info.numBytes = numBytes;
+            info.alignment = alignment;
+            info.tag = tag;
+
+            void* ret = NULL;
+
+            for( u32 i = 0; i < numHandlers && ret == NULL; ++i )
+            {
+                {
+                    ScopedPolicyLock< LockPolicy > lock( m_lock );
+                    GetFreeSpace( info.largestFreeBlock, info.totalFreeBytes );
+                }
+
+                info.handlerIndex = i;
+
+                if( handlers[ i ].handler( info, handlers[ i ].userData ) )
+                {
+                    // a handler may have released memory the heap can grow
+                    // into, as well as freeing blocks
+                    ScopedPolicyLock< LockPolicy > lock( m_lock );
+                    ret = TryAllocateOrGrow( numBytes, alignment, tag, blocksVisited );
+                }
+            }
+
+            g_oomHandlerScopes = scope.next;
+
+            return ret;
+        }
+
+
+        /*====================================================================
+
+            BasicFreeListAllocator::Trim
+            - offers every free block to PagePolicy::Trim, ie after a load
+              spike or before going idle
+            - @return: number of bytes given back
+
+        ====================================================================*/
+        FREELIST_TEMPLATE
+        u32 FREELIST_CLASS::Trim( )
+        {
+            ScopedPolicyLock< LockPolicy > lock( m_lock );
+
+            u32 released = 0;
+
+            for( block_s* block = m_firstFree; block; block = GetNext( block ) )
+            {
+                released += m_pages.Trim( GetBlockData( block ), block->size );
+            }
+
+            return released;
+        }
+
+
+        /*====================================================================
+
+            BasicFreeListAllocator::AddOutOfMemoryHandler( out_of_memory_handler_t handler, void* userData )
+            - appends handler to the end of the chain
+            - @return: false if the chain is full
+
+        ====================================================================*/
+        FREELIST_TEMPLATE
+        bool FREELIST_CLASS::AddOutOfMemoryHandler( out_of_memory_handler_t handler, void* userData )
+        {
+            ScopedPolicyLock< LockPolicy > lock( m_lock );
+
+            if( m_numOomHandlers == MAX_OOM_HANDLERS )
+            {
+                DEBUG_ASSERT( false && "Too many out of memory handlers" );
+                return false;
+            }
+
+            m_oomHandlers[ m_numOomHandlers ].handler = handler;
+            m_oomHandlers[ m_numOomHandlers ].userData = userData;
+            ++m_numOomHandlers;
+
+            return true;
+        }
+
+
+        /*====================================================================
+
+            BasicFreeListAllocator::RemoveOutOfMemoryHandler( out_of_memory_handler_t handler, void* userData )
+            - removes the handler added with the same handler and userData,
+              keeping the order of the rest of the chain
+
+        ====================================================================*/
+        FREELIST_TEMPLATE
+        void FREELIST_CLASS::RemoveOutOfMemoryHandler( out_of_memory_handler_t handler, void* userData )
+        {
+            ScopedPolicyLock< LockPolicy > lock( m_lock );
+
+            for( u32 i = 0; i < m_numOomHandlers; ++i )
+            {
+                if( m_oomHandlers[ i ].handler == handler && m_oomHandlers[ i ].userData == userData )
+                {
+                    memmove( &m_oomHandlers[ i ], &m_oomHandlers[ i + 1 ], sizeof( oom_handler_s ) * ( m_numOomHandlers - i - 1 ) );
+                    --m_numOomHandlers;
+                    return;
+                }
+            }
+        }
+
+
+        /*====================================================================
+
+            BasicFreeListAllocator::GetFreeSpace( u32& largestFreeBlock, u32& totalFreeBytes )
+            - walks the free list for the usable size of the largest free
+              block and of all free blocks together
+
+        ====================================================================*/
+        FREELIST_TEMPLATE
+        void FREELIST_CLASS::GetFreeSpace( u32& largestFreeBlock, u32& totalFreeBytes ) const
+        {
+            largestFreeBlock = 0;
+            totalFreeBytes = 0;
+
+            for( block_s* block = m_firstFree; block; block = GetNext( block ) )
+            {
+                if( block->size > largestFreeBlock )
+                {
+                    largestFreeBlock = block->size;
+                }
+
+                totalFreeBytes += block->size;
+            }
+        }
+
+
+        /*====================================================================
+
+            BasicFreeListAllocator::AllocateAtLeast( u32 numBytes, const align_t alignment )
+            - Allocate aligned memory of at least numBytes size.
+            - when the free block used for the allocation is too small to be
+              split, the whole block is handed out. the extra bytes are
+              reported back so the caller can make use of them
+            - @return: pointer to memory aligned block and its usable size
+
+        ====================================================================*/
+        FREELIST_TEMPLATE
+        inline allocation_s FREELIST_CLASS::AllocateAtLeast( u32 numBytes, const align_t alignment )
+        {
+            allocation_s result;
+            result.ptr  = AllocateAligned( numBytes, alignment );
+            result.size = result.ptr ? GetSize( GetBlock( result.ptr ) ) : 0;
+
+            return result;
+        }
+
+
+        /*====================================================================
+
+            BasicFreeListAllocator::Free( void* ptr )
+            - frees the specified block of memory and returns it to the internal
+              free list
+            - coalesces/joins adjacent free blocks of memory
+            - sorts free blocks of memory based on address
+            - ptr is checked by DebugPolicy::IsValidBlock before its header is
+              read. pointers it rejects fail an assertion and are ignored
+
+            TODO:
+            - Fail an assertion if trying to free a NULL pointer
+
+        ====================================================================*/
+        FREELIST_TEMPLATE
+        inline void FREELIST_CLASS::Free( void* ptr )
+        {
+            if ( ptr == NULL )
+            {
+                // trying to free a NULL ptr
+                return;
+            }
+
+            u64 startTime = StatsPolicy::TIMED_OPERATIONS ? ReadCycleCounter() : 0;
+
+            // get the block header for the ptr
+            block_s* block = GetBlock( ptr );
+
+            ScopedPolicyLock< LockPolicy > lock( m_lock );
+
+            if( !m_debug.IsValidBlock( ptr ) )
+            {
+                // foreign, interior or already freed pointer
+                m_debug.OnInvalidPointer( ptr );
+                DEBUG_ASSERT( false && "Freeing a pointer that is not an allocated block" );
+                return;
+            }
+
+            if ( IsBlockFree( block ) )
+            {
+                // block has already been freed
+                return;
+            }
+
+            FreeBlock( block, GetSize( block ), startTime );
+        }
+
+
+        /*====================================================================
+
+            BasicFreeListAllocator::Free( void* ptr, u32 numBytes )
+            - sized version of Free. numBytes must be the usable size of the
+              block, as reported by AllocateAtLeast or GetBlockSize, and is
+              used in place of the size in the block header
+            - the header's size and free bit are only read by debug builds,
+              to check numBytes and catch double frees. the header is still
+              written, since the block is linked into the free list
+
+        ====================================================================*/
+        FREELIST_TEMPLATE
+        inline void FREELIST_CLASS::Free( void* ptr, u32 numBytes )
+        {
+            if ( ptr == NULL )
+            {
+                return;
+            }
+
+            u64 startTime = StatsPolicy::TIMED_OPERATIONS ? ReadCycleCounter() : 0;
+
+            block_s* block = GetBlock( ptr );
+
+            ScopedPolicyLock< LockPolicy > lock( m_lock );
+
+            if( !m_debug.IsValidBlock( ptr ) )
+            {
+                m_debug.OnInvalidPointer( ptr );
+                DEBUG_ASSERT( false && "Freeing a pointer that is not an allocated block" );
+                return;
+            }
+
+            DEBUG_ASSERT( !IsBlockFree( block ) && "Freeing a block that is already free" );
+            DEBUG_ASSERT( numBytes == GetSize( block ) && "Freeing a block with a size other than its usable size" );
+
+            FreeBlock( block, numBytes, startTime );
+        }
+
+
+        /*====================================================================
+
+            BasicFreeListAllocator::IsIntactBlock( const block_s* block, u32 blockSize )
+            - asks DebugPolicy whether the block's header still holds the
+              canary it was given when allocated
+            - blocks restored from an image saved without canaries have
+              none until they are allocated again, and are let through
+
+        ====================================================================*/
+        FREELIST_TEMPLATE
+        inline bool FREELIST_CLASS::IsIntactBlock( const block_s* block, u32 blockSize ) const
+        {
+            u32 canary = GetHeaderCanary( block );
+
+            if( canary == 0 && m_uncheckedCanaries )
+            {
+                return true;
+            }
+
+            return m_debug.IsIntactBlock( GetBlockData( block ), blockSize, canary );
+        }
+
+
+        /*====================================================================
+
+            BasicFreeListAllocator::FreeBlock( block_s* block, u32 blockSize, u64 startTime )
+            - returns an in use block of blockSize usable bytes to the free
+              list, once Free has validated it. called with the lock held
+            - blocks whose header DebugPolicy finds overwritten are leaked
+
+        ====================================================================*/
+        FREELIST_TEMPLATE
+        inline void FREELIST_CLASS::FreeBlock( block_s* block, u32 blockSize, u64 startTime )
+        {
+            void* ptr = GetBlockData( block );
+
+            if( !IsIntactBlock( block, blockSize ) )
+            {
+                // the header has been overwritten, so the block can't be put
+                // back in the free list safely. it is leaked instead
+                m_debug.OnInvalidPointer( ptr );
+                DEBUG_ASSERT( false && "Freeing a block whose header has been overwritten" );
+                return;
+            }
+
+            ++m_epoch;
+
+            u32 tag = GetTag( block );
+
+            m_debug.OnFree( ptr, blockSize );
+            m_stats.OnFree( ptr, blockSize, tag );
+
+            // flag the block as being free and clear the tag out of the next
+            // field before the block is linked into the free list
+            block->size = blockSize;
+            SetNext( block, NULL );
+
+            u32 blocksVisited = InsertFreeBlock( block );
+
+            m_stats.OnFreeDone( startTime, ptr, tag, blocksVisited );
+        }
+
+
+        /*====================================================================
+
+            BasicFreeListAllocator::InsertFreeBlock( block_s* block )
+            - links a free block into the address ordered free list and
+              coalesces it with the free blocks on either side of it
+            - the search starts at the top chunk when the block is above
+              it, so blocks bumped off the top chunk don't walk the whole
+              list. a free block that ends up larger than the top chunk
+              takes its place
+            - @return: number of free blocks looked at to find its place
+
+        ====================================================================*/
+        FREELIST_TEMPLATE
+        inline u32 FREELIST_CLASS::InsertFreeBlock( block_s* block )
+        {
+            m_stats.OnFreeBlockAdded( block->size );
+
+            // add block to free list and perform coalescense
+            block_s* prevBlock = NULL;
+            block_s* nextBlock = m_firstFree;
+            u32 blocksVisited = 0;
+
+            // blocks above the top chunk, ie ones that were bumped off it,
+            // start looking from there instead of the head of the list
+            if( FitPolicy::USES_TOP_CHUNK && m_top && m_top < block )
+            {
+                prevBlock = m_top;
+                nextBlock = GetNext( m_top );
+            }
+
+            // find adjacent blocks based on memory address
+            while( nextBlock && nextBlock < block )
+            {
+                prevBlock = nextBlock;
+                nextBlock = GetNext( nextBlock );
+                ++blocksVisited;
+            }
+
+            if( prevBlock )
+            {
+                SetNext( prevBlock, block );
+
+                // check to see if prevBlock and the current block are adjacent
+                byte* nextAddr = ( byte* )prevBlock + prevBlock->size + ALIGNED_HEADER_SIZE;
+
+                if( nextAddr == ( byte* )block )
+                {
+                    // combine the two blocks
+                    m_stats.OnFreeBlocksJoined( prevBlock->size, block->size, prevBlock->size + block->size + ALIGNED_HEADER_SIZE );
+
+                    prevBlock->size += block->size + ALIGNED_HEADER_SIZE;
+                    SetNext( prevBlock, nextBlock );
+
+                    if( m_heapWalks )
+                    {
+                        FixupHeapWalks( block, prevBlock );
+                    }
+
+                    m_fit.OnBlockAbsorbed( block, prevBlock );
+
+                    m_debug.OnHeaderAbsorbed( block, ALIGNED_HEADER_SIZE );
+
+                    // update the block as a whole so we can join with nextBlock if needed
+                    block = prevBlock;
+                }
+            }
+            else
+            {
+                // if a prevBlock wasn't found, this block that is currently being freed
+                // is at a lower memory address than all other free blocks and should be
+                // at the front of the free list
+                m_firstFree = block;
+            }
+
+            if( nextBlock )
+            {
+                SetNext( block, nextBlock );
+
+                // check to see if the current block and nextBlock are adjacent
+                byte* nextAddr = ( byte* )block + block->size + ALIGNED_HEADER_SIZE;
+
+                if( nextAddr == ( byte* )nextBlock )
+                {
+                    // combine the two blocks
+                    m_stats.OnFreeBlocksJoined( block->size, nextBlock->size, block->size + nextBlock->size + ALIGNED_HEADER_SIZE );
+
+                    block->size += nextBlock->size + ALIGNED_HEADER_SIZE;
+                    SetNext( block, GetNext( nextBlock ) );
+
+                    if( m_heapWalks )
+                    {
+                        FixupHeapWalks( nextBlock, block );
+                    }
+
+                    m_fit.OnBlockAbsorbed( nextBlock, block );
+
+                    m_debug.OnHeaderAbsorbed( nextBlock, ALIGNED_HEADER_SIZE );
+
+                    if( FitPolicy::USES_TOP_CHUNK && nextBlock == m_top )
+                    {
+                        m_top = block;
+                    }
+                }
+            }
+
+            // bump whichever is bigger, ie the pages Grow has just committed
+            if( FitPolicy::USES_TOP_CHUNK && ( m_top == NULL || m_top->size < block->size ) )
+            {
+                m_top = block;
+            }
+
+            m_debug.OnFreeSpace( GetBlockData( block ), block->size );
+            m_pages.OnFreeSpace( GetBlockData( block ), block->size );
+
+            return blocksVisited;
+        }
+
+
+        /*====================================================================
+
+            BasicFreeListAllocator::GetBlockSize( void* ptr )
+            - @return: size of specified block of memory, or 0 if
+              DebugPolicy::IsValidBlock rejects ptr
+
+        ====================================================================*/
+        FREELIST_TEMPLATE
+        inline u32 FREELIST_CLASS::GetBlockSize( void* ptr ) const
+        {
+            DEBUG_ASSERT( ptr != NULL && "Trying to get size of a NULL ptr" );
+
+            if( !m_debug.IsValidBlock( ptr ) || !IsIntactBlock( GetBlock( ptr ), GetSize( GetBlock( ptr ) ) ) )
+            {
+                DEBUG_ASSERT( false && "Trying to get size of a pointer that is not an allocated block" );
+                return 0;
+            }
+
+            return GetSize( GetBlock( ptr ) );
+        }
+
+
+        /*====================================================================
+
+            BasicFreeListAllocator::GetBlockTag( void* ptr )
+            - @return: memory tag the block was allocated with
+
+        ====================================================================*/
+        FREELIST_TEMPLATE
+        inline memtag_t FREELIST_CLASS::GetBlockTag( void* ptr ) const
+        {
+            DEBUG_ASSERT( ptr != NULL && "Trying to get tag of a NULL ptr" );
+            DEBUG_ASSERT( !IsBlockFree( GetBlock( ptr ) ) && "Trying to get tag of a block that is not in use" );
+
+            return GetTag( GetBlock( ptr ) );
+        }
+
+
+        /*====================================================================
+
+            BasicFreeListAllocator::GetStats
+            - @return: the counters kept by StatsPolicy
+            - counters are updated as blocks are allocated and freed, except
+              the largest free block. StatsPolicy only tracks the largest
+              size, how many blocks have it and a bound on the next one, so
+              once every block of that size has been allocated from and no
+              block added back since is known to be bigger than the rest,
+              the next call walks the whole free list to find it again.
+              this is not constant time: a heap that keeps allocating from
+              its largest block pays O(free blocks) on most calls
+
+        ====================================================================*/
+        FREELIST_TEMPLATE
+        heap_stats_s FREELIST_CLASS::GetStats( )
+        {
+            ScopedPolicyLock< LockPolicy > lock( m_lock );
+
+            if( m_stats.IsLargestFreeBlockStale() )
+            {
+                u32 largest = 0;
+                u32 numLargest = 0;
+                u32 nextLargest = 0;
+
+                for( block_s* block = m_firstFree; block; block = GetNext( block ) )
+                {
+                    if( block->size > largest )
+                    {
+                        nextLargest = largest;
+                        largest = block->size;
+                        numLargest = 1;
+                    }
+                    else if( block->size == largest )
+                    {
+                        ++numLargest;
+                    }
+                    else if( block->size > nextLargest )
+                    {
+                        nextLargest = block->size;
+                    }
+                }
+
+                m_stats.SetLargestFreeBlock( largest, numLargest, nextLargest );
+            }
+
+            heap_stats_s stats;
+            m_stats.GetStats( stats );
+
+            return stats;
+        }
+
+
+        #undef FREELIST_TEMPLATE
+        #undef FREELIST_CLASS
+    }
+}
@@ -2,16 +2,56 @@
 #define _BB_FREELIST_ALLOCATOR_H_
 
 #include "engine/memory/Allocator.h"
+#include "engine/memory/BasicFreeListAllocator.h"
+#include "engine/memory/FreeListStats.h"
+#include "engine/memory/HeapProfiler.h"
+#include "engine/memory/FreeListDebug.h"
 
 namespace bbengine
 {
     namespace mem
     {
+        // heap statistics are compiled out of shipping builds. per tag
+        // counters and budgets, and the sampling heap profiler, are cheap
+        // enough to keep in every build
+        typedef StatsPolicyPair< TagStatsPolicy, HeapProfileStatsPolicy > ShippingStatsPolicy;
+
+#if defined( BB_SHIPPING )
+        typedef StatsPolicyPair< NullStatsPolicy, ShippingStatsPolicy > DefaultStatsPolicy;
+#else
+        typedef StatsPolicyPair< HeapStatsPolicy, ShippingStatsPolicy > DefaultStatsPolicy;
+#endif
+
+        // pointer validation is on in every build but shipping. the
+        // TieredDebugPolicy level can be raised with BB_MEMORY_DEBUG_LEVEL
+        // when hunting a corruption
+#if !defined( BB_MEMORY_DEBUG_LEVEL )
+    #define BB_MEMORY_DEBUG_LEVEL 1
+#endif
+
+#if defined( BB_SHIPPING )
+        typedef NullDebugPolicy DefaultDebugPolicy;
+#else
+        typedef DebugPolicyPair< ShadowBitmapDebugPolicy, TieredDebugPolicy< BB_MEMORY_DEBUG_LEVEL > > DefaultDebugPolicy;
+#endif
+
+        // first fit keeps the working set packed at the bottom of the heap,
+        // and doesn't keep a top chunk. heaps that mostly grow and shrink
+        // at the top, and can live with the extra fragmentation, can opt in
+        // to TopChunkFitPolicy
+        typedef FirstFitPolicy DefaultFitPolicy;
+
+        typedef BasicFreeListAllocator< DefaultFitPolicy, NullLockPolicy, DefaultStatsPolicy, DefaultDebugPolicy > DefaultFreeListAllocator;
+
+        // Allocator interface over a DefaultFreeListAllocator. Code that does
+        // not need to go through the Allocator interface should use a
+        // BasicFreeListAllocator directly so its calls can be inlined
         class FreeListAllocator : public Allocator
         {
         public:
 
-            FreeListAllocator( u32 heapSize );
+            // heapFlags are heap_flags_e
+            FreeListAllocator( u32 heapSize, u32 heapFlags = 0 );
             ~FreeListAllocator( );
 
             virtual void*   Allocate( u32 numBytes );
@@ -19,21 +59,42 @@ namespace bbengine
             virtual void    Free( void* ptr );
             virtual u32     GetBlockSize( void* ptr );
 
+            virtual allocation_s AllocateAtLeast( u32 numBytes, const align_t alignment = ALIGN_8 );
+            virtual void*   AllocateAligned( u32 numBytes, const align_t alignment, memtag_t tag );
+            virtual void    Free( void* ptr, u32 numBytes );
+
+            // releases every block at once, returning the allocator to the
+            // state it was in after construction. checkLiveBlocks walks the
+            // heap first and fails a debug assertion if any blocks were
+            // still in use. @return: the blocks found in use, 0 unchecked
+            u32             Reset( bool checkLiveBlocks = false );
+
+            // heap counters for HUDs and telemetry. all zero in shipping builds.
+            // may walk the free list, see BasicFreeListAllocator::GetStats
+            heap_stats_s    GetStats( );
+            u32             GetHugePageCount( ) const;
+
+            // per tag usage and budgets. see TagStatsPolicy
+            const mem_tag_stats_s&  GetTagStats( memtag_t tag );
+            void            SetTagBudget( memtag_t tag, u32 budget );
+            void            SetTagBudgetCallback( mem_tag_budget_callback_t callback, void* userData );
+
+            // sampling heap profiler. see HeapProfileStatsPolicy. an interval
+            // of 0 stops sampling
+            void            SetHeapProfileInterval( u32 sampleInterval );
+            // writes the sampled live heap as a pprof heap profile
+            bool            WriteHeapProfile( const char* path );
+
+            // chain of handlers that can free memory when an allocation
+            // fails. see BasicFreeListAllocator::AddOutOfMemoryHandler
+            bool            AddOutOfMemoryHandler( out_of_memory_handler_t handler, void* userData );
+            void            RemoveOutOfMemoryHandler( out_of_memory_handler_t handler, void* userData );
+
         private:
 
             FreeListAllocator( FreeListAllocator& );
 
-            struct block_s
-            {
-                block_s*    next;
-                u32         size;   // lowest order bit used as a "free" flag. since
-                                    // sizes are only ever going to be 8 byte aligned
-                                    // there will be unused lower order bits. bit
-                                    // is set to 1 if in use and 0 if free
-            };
-
-            void*       m_heap;         // ptr to internal memory used for allocations
-            block_s*    m_firstFree;    // head of list of address-ordered free blocks
+            DefaultFreeListAllocator    m_allocator;
         };
     }
 }
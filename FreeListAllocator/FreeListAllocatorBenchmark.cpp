@@ -0,0 +1,370 @@
+/*====================================================================
+
+    FreeListAllocatorBenchmark
+    - microbenchmarks for the memory module. every scenario is run
+      against DefaultFreeListAllocator, the same with its heap on huge
+      pages, the same with the opt in top chunk fit, next fit and best
+      fit in place of first fit, FreeListAllocator ( through the
+      Allocator interface ) and the C runtime heap
+    - unless built with BB_SHIPPING, DefaultFreeListAllocator and every
+      variant of it carry the development stats and debug policies (
+      heap stats, tag stats, the heap profiler, the shadow bitmap and
+      canaries at BB_MEMORY_DEBUG_LEVEL ). the shipping run uses the
+      policies a BB_SHIPPING build gets, whatever this is built with,
+      and is the one to compare against malloc
+    - results are written to stdout as JSON so they can be compared
+      between engine versions. scenarios that keep a working set
+      live report the heap's fragmentation before freeing it
+
+    usage: FreeListAllocatorBenchmark [scale]
+    scale multiplies the iteration count of every scenario ( default 1 )
+
+====================================================================*/
+#include "engine/memory/FreeListAllocator.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <random>
+#include <vector>
+
+using namespace bbengine;
+using namespace bbengine::mem;
+
+namespace
+{
+    const u32 DEFAULT_HEAP_SIZE = 64u << 20;
+    const u32 LARGE_HEAP_SIZE   = 1024u << 20;
+
+    // DefaultFreeListAllocator with its heap mapped on huge pages
+    class HugePageFreeListAllocator : public DefaultFreeListAllocator
+    {
+    public:
+        explicit HugePageFreeListAllocator( u32 heapSize )
+            : DefaultFreeListAllocator( heapSize, HEAP_HUGE_PAGES )
+        {
+        }
+    };
+
+    // DefaultFreeListAllocator as a BB_SHIPPING build configures it
+    typedef BasicFreeListAllocator< DefaultFitPolicy, NullLockPolicy, StatsPolicyPair< NullStatsPolicy, ShippingStatsPolicy >, NullDebugPolicy > ShippingFreeListAllocator;
+
+    typedef BasicFreeListAllocator< TopChunkFitPolicy< 16 >, NullLockPolicy, DefaultStatsPolicy, DefaultDebugPolicy > TopChunkFreeListAllocator;
+    typedef BasicFreeListAllocator< NextFitPolicy, NullLockPolicy, DefaultStatsPolicy, DefaultDebugPolicy > NextFitFreeListAllocator;
+    typedef BasicFreeListAllocator< BestFitPolicy, NullLockPolicy, DefaultStatsPolicy, DefaultDebugPolicy > BestFitFreeListAllocator;
+
+    // same interface as the allocators, over the C runtime heap
+    class MallocBenchAllocator
+    {
+    public:
+        explicit MallocBenchAllocator( u32 heapSize )   { ( void )heapSize; }
+
+        void* Allocate( u32 numBytes )                  { return malloc( numBytes ); }
+        void* AllocateAligned( u32 numBytes, const align_t alignment )
+        {
+            void* ptr = NULL;
+            size_t align = ( size_t )alignment < sizeof( void* ) ? sizeof( void* ) : ( size_t )alignment;
+            return posix_memalign( &ptr, align, numBytes ) == 0 ? ptr : NULL;
+        }
+        void  Free( void* ptr )                         { free( ptr ); }
+        u32   GetHugePageCount( ) const                 { return 0; }
+    };
+
+    // keeps the compiler from dropping allocations whose result is unused
+    volatile size_t s_sink;
+
+    // fragmentation of the heap while the scenario's working set was
+    // live, negative if the scenario didn't record it
+    float s_fragmentation;
+
+    template< class A >
+    void RecordFragmentation( A& allocator )        { s_fragmentation = allocator.GetStats().fragmentation; }
+
+    // the C runtime heap doesn't say, and shipping builds don't keep heap stats
+    void RecordFragmentation( MallocBenchAllocator& ) {}
+    void RecordFragmentation( ShippingFreeListAllocator& ) {}
+
+    u32 RandomSize( std::mt19937& rng, u32 minSize, u32 maxSize )
+    {
+        return minSize + rng() % ( maxSize - minSize + 1 );
+    }
+
+
+    /*====================================================================
+
+        Scenarios
+        - each runs against a freshly constructed allocator and returns
+          the number of Allocate and Free calls it made
+
+    ====================================================================*/
+
+    // one allocation of a fixed size, freed straight away
+    template< class A >
+    u64 SameSizePairs( A& allocator, u32 iterations )
+    {
+        for( u32 i = 0; i < iterations; ++i )
+        {
+            void* ptr = allocator.Allocate( 64 );
+            s_sink += ( size_t )ptr;
+            allocator.Free( ptr );
+        }
+
+        return ( u64 )iterations * 2;
+    }
+
+    // a working set of blocks where a random one is replaced each step
+    template< class A >
+    u64 RandomSizes( A& allocator, u32 iterations )
+    {
+        std::mt19937 rng( 1 );
+        std::vector< void* > live( 1024, ( void* )NULL );
+        u64 ops = 0;
+
+        for( u32 i = 0; i < iterations; ++i )
+        {
+            void*& slot = live[ rng() % live.size() ];
+
+            if( slot )
+            {
+                allocator.Free( slot );
+                ++ops;
+            }
+
+            slot = allocator.Allocate( RandomSize( rng, 16, 4096 ) );
+            ++ops;
+        }
+
+        RecordFragmentation( allocator );
+
+        for( size_t i = 0; i < live.size(); ++i )
+        {
+            if( live[ i ] )
+            {
+                allocator.Free( live[ i ] );
+                ++ops;
+            }
+        }
+
+        return ops;
+    }
+
+    // batches of allocations freed in reverse ( LIFO ) or in order ( FIFO )
+    template< class A >
+    u64 BatchFree( A& allocator, u32 iterations, bool lifo )
+    {
+        const u32 batchSize = 1000;
+
+        std::mt19937 rng( 2 );
+        std::vector< void* > batch( batchSize );
+        u64 ops = 0;
+
+        for( u32 i = 0; i < iterations / batchSize; ++i )
+        {
+            for( u32 j = 0; j < batchSize; ++j )
+            {
+                batch[ j ] = allocator.Allocate( RandomSize( rng, 16, 512 ) );
+            }
+
+            for( u32 j = 0; j < batchSize; ++j )
+            {
+                allocator.Free( batch[ lifo ? batchSize - 1 - j : j ] );
+            }
+
+            ops += batchSize * 2;
+        }
+
+        return ops;
+    }
+
+    template< class A >
+    u64 LifoFree( A& allocator, u32 iterations )    { return BatchFree( allocator, iterations, true ); }
+
+    template< class A >
+    u64 FifoFree( A& allocator, u32 iterations )    { return BatchFree( allocator, iterations, false ); }
+
+    // fills the heap with small blocks, frees every other one and then
+    // makes requests that are slightly too big for any of the holes
+    template< class A >
+    u64 Fragmentation( A& allocator, u32 iterations )
+    {
+        const u32 holeCount = 4096;
+
+        std::vector< void* > blocks( holeCount * 2 );
+        u64 ops = 0;
+
+        for( size_t i = 0; i < blocks.size(); ++i )
+        {
+            blocks[ i ] = allocator.Allocate( 64 );
+            ++ops;
+        }
+
+        for( size_t i = 0; i < blocks.size(); i += 2 )
+        {
+            allocator.Free( blocks[ i ] );
+            blocks[ i ] = NULL;
+            ++ops;
+        }
+
+        for( u32 i = 0; i < iterations / 16; ++i )
+        {
+            void* ptr = allocator.Allocate( 128 );
+            s_sink += ( size_t )ptr;
+            allocator.Free( ptr );
+            ops += 2;
+        }
+
+        RecordFragmentation( allocator );
+
+        for( size_t i = 0; i < blocks.size(); ++i )
+        {
+            if( blocks[ i ] )
+            {
+                allocator.Free( blocks[ i ] );
+                ++ops;
+            }
+        }
+
+        return ops;
+    }
+
+    // random sizes with 16 to 128 byte alignment
+    template< class A >
+    u64 Aligned( A& allocator, u32 iterations )
+    {
+        std::mt19937 rng( 3 );
+        std::vector< void* > live( 256, ( void* )NULL );
+        u64 ops = 0;
+
+        for( u32 i = 0; i < iterations; ++i )
+        {
+            void*& slot = live[ rng() % live.size() ];
+
+            if( slot )
+            {
+                allocator.Free( slot );
+                ++ops;
+            }
+
+            slot = allocator.AllocateAligned( RandomSize( rng, 16, 1024 ), ( align_t )( 16u << ( rng() % 4 ) ) );
+            ++ops;
+        }
+
+        RecordFragmentation( allocator );
+
+        for( size_t i = 0; i < live.size(); ++i )
+        {
+            if( live[ i ] )
+            {
+                allocator.Free( live[ i ] );
+                ++ops;
+            }
+        }
+
+        return ops;
+    }
+
+    // a large working set spread over a large heap
+    template< class A >
+    u64 LargeHeap( A& allocator, u32 iterations )
+    {
+        std::mt19937 rng( 4 );
+        std::vector< void* > live( 16 * 1024, ( void* )NULL );
+        u64 ops = 0;
+
+        for( u32 i = 0; i < iterations; ++i )
+        {
+            void*& slot = live[ rng() % live.size() ];
+
+            if( slot )
+            {
+                allocator.Free( slot );
+                ++ops;
+            }
+
+            slot = allocator.Allocate( RandomSize( rng, 64, 16 * 1024 ) );
+            ++ops;
+        }
+
+        RecordFragmentation( allocator );
+
+        for( size_t i = 0; i < live.size(); ++i )
+        {
+            if( live[ i ] )
+            {
+                allocator.Free( live[ i ] );
+                ++ops;
+            }
+        }
+
+        return ops;
+    }
+
+
+    /*====================================================================
+
+        Run
+        - times one scenario against one allocator and writes a JSON
+          object with the results
+
+    ====================================================================*/
+    bool s_firstResult = true;
+
+    template< class A >
+    void Run( const char* scenario, const char* allocatorName, u64 ( *bench )( A&, u32 ), u32 heapSize, u32 iterations )
+    {
+        A allocator( heapSize );
+        s_fragmentation = -1.0f;
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        u64 ops = bench( allocator, iterations );
+        double seconds = std::chrono::duration< double >( std::chrono::steady_clock::now() - start ).count();
+
+        char fragmentation[ 32 ] = "null";
+
+        if( s_fragmentation >= 0.0f )
+        {
+            snprintf( fragmentation, sizeof( fragmentation ), "%.4f", s_fragmentation );
+        }
+
+        printf( "%s\n    { \"scenario\": \"%s\", \"allocator\": \"%s\", \"heap_size\": %u, \"ops\": %llu, \"ns_per_op\": %.2f, \"ops_per_sec\": %.0f, \"huge_pages\": %u, \"fragmentation\": %s }",
+                s_firstResult ? "" : ",", scenario, allocatorName, heapSize, ( unsigned long long )ops,
+                seconds * 1e9 / ( double )ops, ( double )ops / seconds, allocator.GetHugePageCount(), fragmentation );
+
+        s_firstResult = false;
+        fflush( stdout );
+    }
+
+    #define RUN_SCENARIO( name, func, heapSize, iterations )                                                          \
+        Run< DefaultFreeListAllocator >( name, "BasicFreeListAllocator", &func< DefaultFreeListAllocator >, heapSize, iterations ); \
+        Run< ShippingFreeListAllocator >( name, "BasicFreeListAllocator (shipping)", &func< ShippingFreeListAllocator >, heapSize, iterations ); \
+        Run< HugePageFreeListAllocator >( name, "BasicFreeListAllocator (huge pages)", &func< HugePageFreeListAllocator >, heapSize, iterations ); \
+        Run< TopChunkFreeListAllocator >( name, "BasicFreeListAllocator (top chunk)", &func< TopChunkFreeListAllocator >, heapSize, iterations ); \
+        Run< NextFitFreeListAllocator >( name, "BasicFreeListAllocator (next fit)", &func< NextFitFreeListAllocator >, heapSize, iterations ); \
+        Run< BestFitFreeListAllocator >( name, "BasicFreeListAllocator (best fit)", &func< BestFitFreeListAllocator >, heapSize, iterations ); \
+        Run< FreeListAllocator >( name, "FreeListAllocator", &func< FreeListAllocator >, heapSize, iterations );      \
+        Run< MallocBenchAllocator >( name, "malloc", &func< MallocBenchAllocator >, heapSize, iterations );
+}
+
+
+int main( int argc, char** argv )
+{
+    u32 scale = argc > 1 ? ( u32 )atoi( argv[ 1 ] ) : 1;
+
+    if( scale == 0 )
+    {
+        scale = 1;
+    }
+
+    printf( "{\n  \"benchmark\": \"FreeListAllocator\",\n  \"results\": [" );
+
+    RUN_SCENARIO( "same_size_pairs",    SameSizePairs,  DEFAULT_HEAP_SIZE,  scale * 4000000 );
+    RUN_SCENARIO( "random_sizes",       RandomSizes,    DEFAULT_HEAP_SIZE,  scale * 1000000 );
+    RUN_SCENARIO( "lifo_free",          LifoFree,       DEFAULT_HEAP_SIZE,  scale * 1000000 );
+    RUN_SCENARIO( "fifo_free",          FifoFree,       DEFAULT_HEAP_SIZE,  scale * 1000000 );
+    RUN_SCENARIO( "fragmentation",      Fragmentation,  DEFAULT_HEAP_SIZE,  scale * 1000000 );
+    RUN_SCENARIO( "aligned",            Aligned,        DEFAULT_HEAP_SIZE,  scale * 1000000 );
+    RUN_SCENARIO( "large_heap",         LargeHeap,      LARGE_HEAP_SIZE,    scale * 20000 );
+
+    printf( "\n  ]\n}\n" );
+
+    return 0;
+}
@@ -0,0 +1,1339 @@
+/*====================================================================
+
+    FreeListAllocatorTests
+    - behaviour tests for BasicFreeListAllocator's bookkeeping. each
+      test drives an allocator through the case it covers and checks
+      what the allocator keeps track of against a full scan of the
+      heap or the free list
+    - run by ctest from the build directory, where the image test
+      writes its file. exits with 1 if any check fails
+
+====================================================================*/
+#include "engine/memory/FreeListAllocator.h"
+#include "engine/memory/OutOfBandFreeListAllocator.h"
+#include "engine/memory/AllocTraceRecorder.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+using namespace bbengine;
+using namespace bbengine::mem;
+
+namespace
+{
+    u32 s_failures = 0;
+
+    #define CHECK( cond )                                                           \
+        do                                                                          \
+        {                                                                           \
+            if( !( cond ) )                                                         \
+            {                                                                       \
+                fprintf( stderr, "%s:%d: CHECK( %s ) failed\n", __FILE__, __LINE__, #cond );   \
+                ++s_failures;                                                       \
+            }                                                                       \
+        } while( 0 )
+
+    typedef BasicFreeListAllocator< FirstFitPolicy, NullLockPolicy, NullStatsPolicy, NullDebugPolicy > FirstFitHeap;
+    typedef BasicFreeListAllocator< TopChunkFitPolicy< 4 >, NullLockPolicy, NullStatsPolicy, NullDebugPolicy > TopChunkHeap;
+    typedef BasicFreeListAllocator< FirstFitPolicy, NullLockPolicy, NullStatsPolicy, NullDebugPolicy, PointerBlockHeader > PointerHeap;
+    typedef BasicFreeListAllocator< FirstFitPolicy, NullLockPolicy, HeapStatsPolicy, NullDebugPolicy, OffsetBlockHeader > ImageHeap;
+    typedef BasicFreeListAllocator< FirstFitPolicy, NullLockPolicy, HeapStatsPolicy, ShadowBitmapDebugPolicy > CheckedHeap;
+    typedef BasicFreeListAllocator< FirstFitPolicy, NullLockPolicy, TraceStatsPolicy, NullDebugPolicy > TracedHeap;
+    typedef BasicFreeListAllocator< FirstFitPolicy, NullLockPolicy, HeapStatsPolicy, TieredDebugPolicy< 1 > > CanaryHeap;
+    typedef BasicFreeListAllocator< FirstFitPolicy, NullLockPolicy, NullStatsPolicy, NullDebugPolicy, DefaultBlockHeader, TrimPagePolicy > TrimHeap;
+    typedef BasicFreeListAllocator< FirstFitPolicy, NullLockPolicy, HeapStatsPolicy, TieredDebugPolicy< 1 >, OffsetBlockHeader > CanaryImageHeap;
+    typedef BasicFreeListAllocator< NextFitPolicy, NullLockPolicy, NullStatsPolicy, TieredDebugPolicy< 2 > > NextFitHeap;
+
+    const u32 HEAP_SIZE = 1u << 20;
+
+
+    /*====================================================================
+
+        CheckTopChunk
+        - the top chunk is only kept when FitPolicy sets USES_TOP_CHUNK,
+          and then must be in the free list whenever the list isn't empty
+
+    ====================================================================*/
+    template< class Heap >
+    void CheckTopChunk( Heap& heap )
+    {
+        typename Heap::block_s* top = heap.GetTopChunk();
+        bool found = false;
+
+        for( typename Heap::block_s* block = heap.GetFirstFree(); block; block = heap.GetNext( block ) )
+        {
+            found = found || block == top;
+        }
+
+        if( Heap::fit_t::USES_TOP_CHUNK )
+        {
+            CHECK( top == NULL ? heap.GetFirstFree() == NULL : found );
+        }
+        else
+        {
+            CHECK( top == NULL );
+        }
+
+        CHECK( heap.Verify( 0xFFFFFFFFu ) );
+    }
+
+
+    // allocations are carved off the end of the top chunk, which stays put
+    void TestTopChunkBump( )
+    {
+        TopChunkHeap heap( HEAP_SIZE );
+        CheckTopChunk( heap );
+
+        TopChunkHeap::block_s* top = heap.GetTopChunk();
+        u32 topSize = TopChunkHeap::GetSize( top );
+
+        void* first = heap.Allocate( 100 );
+        CheckTopChunk( heap );
+
+        void* second = heap.Allocate( 200 );
+        CheckTopChunk( heap );
+
+        CHECK( heap.GetTopChunk() == top );
+        CHECK( ( byte* )second < ( byte* )first && ( byte* )top < ( byte* )second );
+        CHECK( TopChunkHeap::GetSize( top ) == topSize - heap.GetBlockSize( first ) - heap.GetBlockSize( second ) - 2 * TopChunkHeap::ALIGNED_HEADER_SIZE );
+
+        // second is right above the top chunk, so this joins both back in
+        heap.Free( first );
+        heap.Free( second );
+        CheckTopChunk( heap );
+
+        CHECK( heap.GetFirstFree() == top && heap.GetNext( top ) == NULL );
+        CHECK( TopChunkHeap::GetSize( top ) == topSize );
+    }
+
+
+    // blocks freed above the top chunk start their search there and
+    // coalesce back into it
+    void TestTopChunkCoalesce( )
+    {
+        TopChunkHeap heap( HEAP_SIZE );
+        std::vector< void* > blocks;
+
+        for( u32 i = 0; i < 8; ++i )
+        {
+            blocks.push_back( heap.Allocate( 64 ) );
+        }
+
+        TopChunkHeap::block_s* top = heap.GetTopChunk();
+
+        // holes above the top chunk, then the block touching it
+        heap.Free( blocks[ 1 ] );
+        heap.Free( blocks[ 5 ] );
+        CheckTopChunk( heap );
+
+        heap.Free( blocks[ 7 ] );
+        CheckTopChunk( heap );
+
+        // joins the hole at 5 to the top chunk through 6
+        heap.Free( blocks[ 6 ] );
+        CheckTopChunk( heap );
+
+        CHECK( heap.GetTopChunk() == top );
+        CHECK( heap.GetNext( top ) == TopChunkHeap::GetBlock( blocks[ 1 ] ) );
+
+        for( u32 i = 0; i < 5; ++i )
+        {
+            if( i != 1 )
+            {
+                heap.Free( blocks[ i ] );
+                CheckTopChunk( heap );
+            }
+        }
+
+        CHECK( heap.GetFirstFree() == top && heap.GetNext( top ) == NULL );
+    }
+
+
+    // a freed block larger than the top chunk takes its place, and the top
+    // chunk follows it when it is coalesced into the block below
+    void TestTopChunkAbsorbed( )
+    {
+        TopChunkHeap heap( HEAP_SIZE );
+
+        TopChunkHeap::block_s* low = heap.GetTopChunk();
+        void* big = heap.Allocate( HEAP_SIZE / 2 );
+        void* small = heap.Allocate( 64 );
+        void* rest = heap.Allocate( TopChunkHeap::GetSize( low ) - 1024 );
+        CHECK( big && small && rest );
+        CHECK( TopChunkHeap::GetSize( low ) < HEAP_SIZE / 2 );
+
+        heap.Free( big );
+        CheckTopChunk( heap );
+        CHECK( heap.GetTopChunk() == TopChunkHeap::GetBlock( big ) );
+
+        // big, the top chunk, is joined to the block below it
+        heap.Free( small );
+        CheckTopChunk( heap );
+        CHECK( heap.GetTopChunk() == TopChunkHeap::GetBlock( small ) );
+
+        // and that is joined to the old top chunk through rest
+        heap.Free( rest );
+        CheckTopChunk( heap );
+        CHECK( heap.GetTopChunk() == low );
+    }
+
+
+    // the top chunk stays in the free list when it is used up, and the rest
+    // of the list is searched once it is too small
+    void TestTopChunkExhausted( )
+    {
+        TopChunkHeap heap( HEAP_SIZE );
+        std::vector< void* > blocks;
+
+        void* hole = heap.Allocate( 512 );
+
+        for( u32 i = 0; i < 12; ++i )
+        {
+            blocks.push_back( heap.Allocate( 64 ) );
+        }
+
+        // more small holes in front of it than the policy probes
+        heap.Free( hole );
+
+        for( u32 i = 1; i < 11; i += 2 )
+        {
+            heap.Free( blocks[ i ] );
+        }
+
+        CheckTopChunk( heap );
+
+        TopChunkHeap::block_s* top = heap.GetTopChunk();
+        void* rest = heap.Allocate( TopChunkHeap::GetSize( top ) - TopChunkHeap::ALIGNED_HEADER_SIZE );
+        CHECK( rest != NULL );
+        CHECK( heap.GetTopChunk() == top && TopChunkHeap::GetSize( top ) == 0 );
+        CheckTopChunk( heap );
+
+        void* fallback = heap.Allocate( 400 );
+        CHECK( fallback == hole );
+        CheckTopChunk( heap );
+
+        void* none = heap.Allocate( 1024 );
+        CHECK( none == NULL );
+
+        heap.Free( fallback );
+        heap.Free( rest );
+        CheckTopChunk( heap );
+
+        for( u32 i = 0; i < 12; i += 2 )
+        {
+            heap.Free( blocks[ i ] );
+        }
+
+        heap.Free( blocks[ 11 ] );
+
+        CheckTopChunk( heap );
+        CHECK( heap.GetFirstFree() == top && heap.GetNext( top ) == NULL );
+    }
+
+
+    // heaps whose FitPolicy doesn't use a top chunk don't keep one
+    void TestTopChunkUnused( )
+    {
+        FirstFitHeap heap( HEAP_SIZE );
+        CheckTopChunk( heap );
+
+        void* first = heap.Allocate( 100 );
+        void* second = heap.Allocate( 200 );
+        CHECK( ( byte* )first < ( byte* )second );
+        CheckTopChunk( heap );
+
+        heap.Free( first );
+        heap.Free( second );
+        CheckTopChunk( heap );
+    }
+
+
+    // a reserved heap's new pages become or join the top chunk
+    void TestTopChunkGrow( )
+    {
+        TopChunkHeap heap( 64u << 20, HEAP_RESERVE );
+
+        if( heap.GetReservedSize() == heap.GetHeapSize() )
+        {
+            printf( "  HEAP_RESERVE not supported, skipped\n" );
+            return;
+        }
+
+        std::vector< void* > blocks;
+        u32 startSize = heap.GetHeapSize();
+
+        while( heap.GetHeapSize() < startSize * 4 )
+        {
+            void* ptr = heap.Allocate( 16000 );
+            CHECK( ptr != NULL );
+
+            if( ptr == NULL )
+            {
+                break;
+            }
+
+            blocks.push_back( ptr );
+            CheckTopChunk( heap );
+        }
+
+        // a hole below the top chunk when the heap grows again
+        heap.Free( blocks[ blocks.size() / 2 ] );
+        blocks[ blocks.size() / 2 ] = blocks.back();
+        blocks.pop_back();
+
+        u32 grownSize = heap.GetHeapSize();
+
+        while( heap.GetHeapSize() == grownSize )
+        {
+            void* ptr = heap.Allocate( 16000 );
+            CHECK( ptr != NULL );
+
+            if( ptr == NULL )
+            {
+                break;
+            }
+
+            blocks.push_back( ptr );
+            CheckTopChunk( heap );
+        }
+
+        for( size_t i = 0; i < blocks.size(); ++i )
+        {
+            heap.Free( blocks[ i ] );
+        }
+
+        CheckTopChunk( heap );
+    }
+
+
+    // Reset leaves a single free block, which is the top chunk
+    void TestTopChunkReset( )
+    {
+        TopChunkHeap heap( HEAP_SIZE );
+
+        for( u32 i = 0; i < 32; ++i )
+        {
+            void* ptr = heap.Allocate( 100 + i * 10 );
+
+            if( i % 3 == 0 )
+            {
+                heap.Free( ptr );
+            }
+        }
+
+        heap.Reset();
+        CheckTopChunk( heap );
+
+        CHECK( heap.GetTopChunk() == heap.GetFirstFree() );
+
+        heap.Allocate( 64 );
+        CheckTopChunk( heap );
+    }
+
+
+    // random allocations and frees, checked after every call
+    void TestTopChunkRandom( )
+    {
+        TopChunkHeap heap( HEAP_SIZE );
+        std::vector< void* > live;
+        srand( 1 );
+
+        for( u32 i = 0; i < 20000; ++i )
+        {
+            if( live.empty() || rand() % 5 < 3 )
+            {
+                void* ptr = heap.Allocate( 16 + rand() % 2000 );
+
+                if( ptr )
+                {
+                    live.push_back( ptr );
+                }
+            }
+            else
+            {
+                size_t index = ( size_t )rand() % live.size();
+                heap.Free( live[ index ] );
+                live[ index ] = live.back();
+                live.pop_back();
+            }
+
+            CheckTopChunk( heap );
+
+            if( s_failures )
+            {
+                fprintf( stderr, "  after %u operations\n", i );
+                return;
+            }
+        }
+    }
+
+
+    /*====================================================================
+
+        GetBlockStarts
+        - @return: the usable memory of every block, found by stepping
+          over block sizes from the first free or in use block
+
+    ====================================================================*/
+    template< class Heap >
+    std::vector< void* > GetBlockStarts( Heap& heap, void* firstBlock )
+    {
+        std::vector< void* > starts;
+        byte* end = ( byte* )heap.GetHeapBase() + heap.GetHeapSize();
+
+        for( byte* block = ( byte* )Heap::GetBlock( firstBlock ); block < end; )
+        {
+            starts.push_back( Heap::GetBlockData( ( typename Heap::block_s* )block ) );
+            block += Heap::ALIGNED_HEADER_SIZE + Heap::GetSize( ( typename Heap::block_s* )block );
+        }
+
+        return starts;
+    }
+
+    // heap walk visitor that checks each block it is given is a block in
+    // the heap as it is now, and that the walk only moves forwards
+    struct walk_checker_s
+    {
+        const std::vector< void* >*     starts;
+        void*                           last;
+        u32                             visited;
+
+        void operator()( const heap_block_info_s& info )
+        {
+            CHECK( std::binary_search( starts->begin(), starts->end(), info.ptr ) );
+            CHECK( info.ptr > last );
+
+            last = info.ptr;
+            ++visited;
+        }
+    };
+
+
+    // a walk that is about to visit a block absorbed by coalescing, from
+    // either side, moves on to the block after the joined one
+    void TestHeapWalkCoalesce( )
+    {
+        PointerHeap heap( HEAP_SIZE );
+        std::vector< void* > blocks;
+
+        for( u32 i = 0; i < 16; ++i )
+        {
+            blocks.push_back( heap.Allocate( 64 ) );
+        }
+
+        std::vector< void* > starts = GetBlockStarts( heap, blocks[ 0 ] );
+        walk_checker_s checker = { &starts, NULL, 0 };
+
+        PointerHeap::heap_walk_s walk;
+        heap.BeginHeapWalk( walk );
+
+        // visits 0-2, so the walk is on 3
+        CHECK( heap.StepHeapWalk( walk, 3, checker ) );
+        CHECK( walk.block == PointerHeap::GetBlock( blocks[ 3 ] ) );
+
+        // 3 is absorbed by the free block in front of it
+        heap.Free( blocks[ 2 ] );
+        heap.Free( blocks[ 3 ] );
+        CHECK( walk.block == PointerHeap::GetBlock( blocks[ 4 ] ) );
+
+        starts = GetBlockStarts( heap, blocks[ 0 ] );
+        CHECK( heap.StepHeapWalk( walk, 2, checker ) );
+        CHECK( walk.block == PointerHeap::GetBlock( blocks[ 6 ] ) );
+
+        // 6 is absorbed by the block freed in front of it, and 7 by that
+        heap.Free( blocks[ 7 ] );
+        heap.Free( blocks[ 5 ] );
+        heap.Free( blocks[ 6 ] );
+        CHECK( walk.block == PointerHeap::GetBlock( blocks[ 8 ] ) );
+
+        // allocating from the joined block again splits it, and the walk
+        // is already past it
+        void* reused = heap.Allocate( 64 );
+        CHECK( reused == blocks[ 2 ] );
+        CHECK( walk.block == PointerHeap::GetBlock( blocks[ 8 ] ) );
+
+        starts = GetBlockStarts( heap, blocks[ 0 ] );
+
+        while( heap.StepHeapWalk( walk, 4, checker ) )
+        {
+        }
+
+        CHECK( walk.block == NULL );
+    }
+
+
+    // several walks stepped between random allocations and frees only ever
+    // visit real blocks, and EndHeapWalk stops one early
+    void TestHeapWalkRandom( )
+    {
+        PointerHeap heap( HEAP_SIZE );
+        std::vector< void* > live;
+        srand( 2 );
+
+        for( u32 i = 0; i < 400; ++i )
+        {
+            live.push_back( heap.Allocate( 16 + rand() % 500 ) );
+        }
+
+        void* first = live[ 0 ];
+        std::vector< void* > starts;
+        walk_checker_s checkers[ 3 ] = { { &starts, NULL, 0 }, { &starts, NULL, 0 }, { &starts, NULL, 0 } };
+        PointerHeap::heap_walk_s walks[ 3 ];
+        bool walking[ 3 ] = { true, true, true };
+
+        for( u32 i = 0; i < 3; ++i )
+        {
+            heap.BeginHeapWalk( walks[ i ] );
+        }
+
+        for( u32 round = 0; walking[ 0 ] || walking[ 1 ]; ++round )
+        {
+            for( u32 op = 0; op < 8; ++op )
+            {
+                if( rand() % 2 )
+                {
+                    void* ptr = heap.Allocate( 16 + rand() % 500 );
+
+                    if( ptr )
+                    {
+                        live.push_back( ptr );
+                    }
+                }
+                else if( live.size() > 1 )
+                {
+                    // the first block stays, so GetBlockStarts can start there
+                    size_t index = 1 + ( size_t )rand() % ( live.size() - 1 );
+                    heap.Free( live[ index ] );
+                    live[ index ] = live.back();
+                    live.pop_back();
+                }
+            }
+
+            starts = GetBlockStarts( heap, first );
+
+            for( u32 i = 0; i < 3; ++i )
+            {
+                if( walking[ i ] )
+                {
+                    walking[ i ] = heap.StepHeapWalk( walks[ i ], 1 + i * 3, checkers[ i ] );
+                }
+            }
+
+            if( round == 20 )
+            {
+                heap.EndHeapWalk( walks[ 2 ] );
+                walking[ 2 ] = false;
+            }
+        }
+
+        CHECK( checkers[ 0 ].visited > 0 && checkers[ 1 ].visited > 0 );
+        CHECK( walks[ 2 ].block == NULL );
+    }
+
+
+    // a Verify spread over many calls while the heap changes in between
+    // picks the free list up again and finds nothing wrong
+    void TestVerifyAcrossChanges( )
+    {
+        PointerHeap heap( HEAP_SIZE );
+        std::vector< void* > live;
+        srand( 4 );
+
+        for( u32 i = 0; i < 20000; ++i )
+        {
+            if( live.empty() || rand() % 5 < 3 )
+            {
+                void* ptr = heap.Allocate( 16 + rand() % 1000 );
+
+                if( ptr )
+                {
+                    live.push_back( ptr );
+                }
+            }
+            else
+            {
+                size_t index = ( size_t )rand() % live.size();
+                heap.Free( live[ index ] );
+                live[ index ] = live.back();
+                live.pop_back();
+            }
+
+            const char* error = NULL;
+            bool ok = heap.Verify( 3, &error );
+            CHECK( ok );
+
+            if( !ok )
+            {
+                fprintf( stderr, "  %s after %u operations\n", error, i );
+                return;
+            }
+        }
+    }
+
+
+    /*====================================================================
+
+        VerifyUntilFailure
+        - runs Verify a few blocks at a time, freeing and reallocating
+          churn between calls so the epoch changes, until it fails or has
+          been round the heap twice. churn is the first block in the heap
+          and is reallocated whole, so it stays where it is
+        - @return: the error Verify found, NULL for none
+
+    ====================================================================*/
+    const char* VerifyUntilFailure( PointerHeap& heap, void* churn, void** badBlock )
+    {
+        u32 numBlocks = ( u32 )GetBlockStarts( heap, churn ).size();
+
+        for( u32 call = 0; call < numBlocks * 2; ++call )
+        {
+            const char* error = NULL;
+
+            if( !heap.Verify( 2, &error, badBlock ) )
+            {
+                return error;
+            }
+
+            u32 size = heap.GetBlockSize( churn );
+            heap.Free( churn );
+            CHECK( heap.Allocate( size - PointerHeap::ALIGNED_HEADER_SIZE ) == churn );
+        }
+
+        return NULL;
+    }
+
+
+    // corruption is found by a sliced Verify whether or not the heap
+    // changed between the calls that walk over it
+    void TestVerifyFindsCorruption( )
+    {
+        PointerHeap heap( HEAP_SIZE );
+        std::vector< void* > blocks;
+
+        // tagged, so an in use block's next field never reads as NULL
+        for( u32 i = 0; i < 40; ++i )
+        {
+            blocks.push_back( heap.AllocateAligned( 64, ALIGN_8, ( memtag_t )( i + 1 ) ) );
+        }
+
+        for( u32 i = 10; i < 40; i += 4 )
+        {
+            heap.Free( blocks[ i ] );
+        }
+
+        void* churn = blocks[ 0 ];
+        void* badBlock = NULL;
+        CHECK( VerifyUntilFailure( heap, churn, &badBlock ) == NULL );
+
+        // an in use block whose free bit is cleared isn't in the free list,
+        // and when the epoch has changed, its tag is seen as a next pointer
+        // that is out of address order
+        PointerHeap::block_s* used = PointerHeap::GetBlock( blocks[ 20 ] );
+        used->size &= ~PointerHeap::FREE_BIT_MASK;
+
+        const char* error = VerifyUntilFailure( heap, churn, &badBlock );
+        CHECK( error != NULL );
+        CHECK( badBlock == used );
+
+        used->size |= PointerHeap::FREE_BIT_MASK;
+
+        // a free block marked in use is still in the free list. this can
+        // only be seen while following the list, so not straight after
+        // the epoch has changed
+        PointerHeap::block_s* free = PointerHeap::GetBlock( blocks[ 26 ] );
+        free->size |= PointerHeap::FREE_BIT_MASK;
+
+        const char* error2 = NULL;
+        void* badBlock2 = NULL;
+        CHECK( !heap.Verify( 0xFFFFFFFFu, &error2, &badBlock2 ) );
+        CHECK( badBlock2 == free );
+
+        free->size &= ~PointerHeap::FREE_BIT_MASK;
+        CHECK( heap.Verify( 0xFFFFFFFFu ) );
+    }
+
+
+    // a heap saved to an image and loaded at another address, and at the
+    // address it was saved from, has its pointers moved, its top chunk
+    // found and its stats rebuilt by RestoreBlocks
+    struct image_node_s
+    {
+        image_node_s*   next;
+        u32             value;
+    };
+
+    void CheckLoadedImage( heap_image_s& image, const heap_stats_s& savedStats, u32 numNodes )
+    {
+        ImageHeap heap( image );
+
+        byte* base = ( byte* )heap.GetHeapBase();
+        u32 count = 0;
+
+        for( image_node_s* node = ( image_node_s* )image.root; node; node = node->next )
+        {
+            CHECK( ( byte* )node >= base && ( byte* )node < base + heap.GetHeapSize() );
+            CHECK( node->value == count );
+
+            if( node->value != count++ || count > numNodes )
+            {
+                break;
+            }
+        }
+
+        CHECK( count == numNodes );
+        CheckTopChunk( heap );
+
+        heap_stats_s stats = heap.GetStats();
+        CHECK( stats.bytesInUse == savedStats.bytesInUse );
+        CHECK( stats.numAllocations == savedStats.numAllocations );
+        CHECK( stats.freeBlockCount == savedStats.freeBlockCount );
+        CHECK( stats.largestFreeBlock == savedStats.largestFreeBlock );
+
+        image_node_s* extra = ( image_node_s* )heap.Allocate( sizeof( image_node_s ) );
+        CHECK( extra != NULL );
+        heap.Free( image.root );
+        heap.Free( extra );
+        CheckTopChunk( heap );
+    }
+
+    void TestImageRestore( )
+    {
+        const char* path = "FreeListAllocatorTests.image";
+        const u32 NUM_NODES = 100;
+
+        ImageHeap* saved = new ImageHeap( HEAP_SIZE, HEAP_RESERVE );
+        std::vector< void* > pointers;
+        image_node_s* head = NULL;
+
+        for( u32 i = NUM_NODES; i-- > 0; )
+        {
+            image_node_s* node = ( image_node_s* )saved->Allocate( sizeof( image_node_s ) + i * 8 );
+            node->next = head;
+            node->value = i;
+            head = node;
+
+            pointers.push_back( &node->next );
+
+            // holes in the free list for RestoreBlocks to find
+            if( i % 7 == 0 )
+            {
+                saved->Free( saved->Allocate( 200 ) );
+                saved->Allocate( 8 );
+            }
+        }
+
+        heap_stats_s savedStats = saved->GetStats();
+        CHECK( saved->SaveImage( path, head, &pointers[ 0 ], ( u32 )pointers.size() ) );
+
+        // the saved heap still holds its address, so this one moves
+        heap_image_s moved;
+        CHECK( ImageHeap::LoadImage( path, moved ) );
+        CHECK( moved.heap != saved->GetHeapBase() );
+
+        void* savedBase = saved->GetHeapBase();
+        delete saved;
+
+        if( moved.heap )
+        {
+            CheckLoadedImage( moved, savedStats, NUM_NODES );
+        }
+
+        // the address is free now, so this one usually goes back there
+        heap_image_s inPlace;
+        CHECK( ImageHeap::LoadImage( path, inPlace ) );
+
+        if( inPlace.heap )
+        {
+            printf( "  %s\n", inPlace.heap == savedBase ? "loaded at the saved address" : "saved address taken, loaded elsewhere" );
+            CheckLoadedImage( inPlace, savedStats, NUM_NODES );
+        }
+
+        remove( path );
+    }
+
+
+    // fills a heap with tagged blocks, saves it and returns the blocks'
+    // offsets from the heap base. the heap is kept, so loads move
+    template< class Heap >
+    bool SaveTaggedImage( Heap& heap, const char* path, std::vector< u32 >& offsets )
+    {
+        for( u32 i = 0; i < 40; ++i )
+        {
+            byte* ptr = ( byte* )heap.AllocateAligned( 24 + i * 8, ALIGN_8, ( memtag_t )( i % 8 ) );
+            offsets.push_back( ( u32 )( ptr - ( byte* )heap.GetHeapBase() ) );
+        }
+
+        return heap.SaveImage( path, NULL, NULL, 0 );
+    }
+
+
+    // images don't depend on the DebugPolicy. blocks from a heap without
+    // canaries load into one that checks them untouched, pass the check
+    // until they are freed, and get a canary when allocated again.
+    // canaries from a heap that has them hold at the new base, and a heap
+    // that doesn't check them still reads the tags
+    void TestImageCanaries( )
+    {
+        const char* path = "FreeListAllocatorTests.image";
+
+        {
+            ImageHeap saved( HEAP_SIZE );
+            std::vector< u32 > offsets;
+            CHECK( SaveTaggedImage( saved, path, offsets ) );
+
+            heap_image_s image;
+            CHECK( CanaryImageHeap::LoadImage( path, image ) );
+            CHECK( !( image.flags & HEAP_IMAGE_BLOCK_CANARIES ) );
+
+            if( image.heap )
+            {
+                CanaryImageHeap loaded( image );
+                byte* base = ( byte* )loaded.GetHeapBase();
+
+                for( u32 i = 0; i < offsets.size(); ++i )
+                {
+                    CanaryImageHeap::block_s* block = CanaryImageHeap::GetBlock( base + offsets[ i ] );
+                    CHECK( CanaryImageHeap::GetHeaderCanary( block ) == 0 );
+                    CHECK( loaded.GetBlockTag( base + offsets[ i ] ) == i % 8 );
+                }
+
+                for( u32 i = 0; i < offsets.size(); i += 2 )
+                {
+                    loaded.Free( base + offsets[ i ] );
+                }
+
+                CHECK( loaded.GetDebugPolicy().GetInvalidPointerCount() == 0 );
+                CHECK( loaded.GetStats().numAllocations == offsets.size() / 2 );
+
+                // the fit test counts a header on top of the request, so this
+                // is the largest request the freed 24 byte block takes
+                void* ptr = loaded.Allocate( 24 - CanaryImageHeap::ALIGNED_HEADER_SIZE );
+                CHECK( ptr == base + offsets[ 0 ] );
+                CHECK( CanaryImageHeap::GetHeaderCanary( CanaryImageHeap::GetBlock( ptr ) ) != 0 );
+                CHECK( loaded.Verify( 0xFFFFFFFFu ) );
+            }
+        }
+
+        {
+            CanaryImageHeap saved( HEAP_SIZE );
+            std::vector< u32 > offsets;
+            CHECK( SaveTaggedImage( saved, path, offsets ) );
+
+            heap_image_s image;
+            CHECK( CanaryImageHeap::LoadImage( path, image ) );
+            CHECK( image.flags & HEAP_IMAGE_BLOCK_CANARIES );
+
+            if( image.heap )
+            {
+                CanaryImageHeap loaded( image );
+                byte* base = ( byte* )loaded.GetHeapBase();
+                CHECK( base != saved.GetHeapBase() );
+
+                for( u32 i = 0; i < offsets.size(); ++i )
+                {
+                    CHECK( loaded.GetBlockSize( base + offsets[ i ] ) == 24 + i * 8 );
+                    loaded.Free( base + offsets[ i ] );
+                }
+
+                CHECK( loaded.GetDebugPolicy().GetInvalidPointerCount() == 0 );
+                CHECK( loaded.GetStats().numAllocations == 0 );
+            }
+
+            CHECK( ImageHeap::LoadImage( path, image ) );
+
+            if( image.heap )
+            {
+                ImageHeap loaded( image );
+                byte* base = ( byte* )loaded.GetHeapBase();
+
+                for( u32 i = 0; i < offsets.size(); ++i )
+                {
+                    CHECK( loaded.GetBlockTag( base + offsets[ i ] ) == i % 8 );
+                }
+
+                CHECK( loaded.GetStats().numAllocations == offsets.size() );
+            }
+        }
+
+        remove( path );
+    }
+
+
+    // a sized Free takes the block's size from the caller. blocks handed
+    // out whole, with more room than was asked for, are freed with the
+    // size AllocateAtLeast reported
+    void TestSizedFree( )
+    {
+        FirstFitHeap heap( HEAP_SIZE );
+        std::vector< allocation_s > blocks;
+
+        for( u32 i = 0; i < 64; ++i )
+        {
+            blocks.push_back( heap.AllocateAtLeast( 16 + i * 24 ) );
+            CHECK( blocks.back().ptr && blocks.back().size >= 16 + i * 24 );
+        }
+
+        // a hole that is too small to split for the next request
+        allocation_s& hole = blocks[ 10 ];
+        u32 holeSize = hole.size;
+        heap.Free( hole.ptr, hole.size );
+
+        allocation_s whole = heap.AllocateAtLeast( holeSize - FirstFitHeap::ALIGNED_HEADER_SIZE - 8 );
+        CHECK( whole.ptr == hole.ptr );
+        CHECK( whole.size == holeSize );
+        hole = whole;
+
+        for( size_t i = 0; i < blocks.size(); i += 2 )
+        {
+            heap.Free( blocks[ i ].ptr, blocks[ i ].size );
+            CHECK( heap.Verify( 0xFFFFFFFFu ) );
+        }
+
+        for( size_t i = 1; i < blocks.size(); i += 2 )
+        {
+            heap.Free( blocks[ i ].ptr, blocks[ i ].size );
+            CHECK( heap.Verify( 0xFFFFFFFFu ) );
+        }
+
+        // everything has coalesced back into one block
+        FirstFitHeap::block_s* first = heap.GetFirstFree();
+        CHECK( first && heap.GetNext( first ) == NULL );
+        CHECK( ( byte* )FirstFitHeap::GetBlockData( first ) + FirstFitHeap::GetSize( first ) == ( byte* )heap.GetHeapBase() + heap.GetHeapSize() );
+    }
+
+
+    // Reset hands back every block at once. the heap, its stats and the
+    // shadow bitmap are left as they were after construction, and walks
+    // in progress are over
+    void TestReset( )
+    {
+        CheckedHeap heap( HEAP_SIZE );
+
+        CheckedHeap::block_s* initial = heap.GetFirstFree();
+        u32 initialSize = CheckedHeap::GetSize( initial );
+        std::vector< void* > blocks;
+
+        for( u32 i = 0; i < 200; ++i )
+        {
+            blocks.push_back( heap.Allocate( 16 + ( i * 37 ) % 700 ) );
+        }
+
+        for( u32 i = 0; i < 200; i += 3 )
+        {
+            heap.Free( blocks[ i ] );
+        }
+
+        CheckedHeap::heap_walk_s walk;
+        heap.BeginHeapWalk( walk );
+
+        heap.Reset();
+
+        CHECK( heap.GetFirstFree() == initial );
+        CHECK( heap.GetNext( initial ) == NULL );
+        CHECK( CheckedHeap::GetSize( initial ) == initialSize );
+        CHECK( walk.block == NULL );
+        CHECK( heap.Verify( 0xFFFFFFFFu ) );
+
+        heap_stats_s stats = heap.GetStats();
+        CHECK( stats.bytesInUse == 0 );
+        CHECK( stats.numAllocations == 0 );
+        CHECK( stats.freeBlockCount == 1 );
+        CHECK( stats.bytesFree == initialSize );
+        CHECK( stats.largestFreeBlock == initialSize );
+
+        // pointers from before the reset are no longer blocks
+        CHECK( !heap.GetDebugPolicy().IsValidBlock( blocks[ 1 ] ) );
+
+        // nothing is live, so the check finds nothing
+        void* ptr = heap.Allocate( 64 );
+        CHECK( ptr == blocks[ 0 ] );
+        heap.Free( ptr );
+        CHECK( heap.Reset( true ) == 0 );
+    }
+
+
+    // Reset( true ) counts the blocks still in use. it also fails a debug
+    // assertion for them, so this only runs where those are compiled out
+    void TestResetLiveBlocks( )
+    {
+#if defined( NDEBUG )
+        CheckedHeap heap( HEAP_SIZE );
+        std::vector< void* > blocks;
+
+        for( u32 i = 0; i < 10; ++i )
+        {
+            blocks.push_back( heap.Allocate( 100 ) );
+        }
+
+        heap.Free( blocks[ 0 ] );
+        heap.Free( blocks[ 4 ] );
+        heap.Free( blocks[ 5 ] );
+
+        CHECK( heap.Reset( true ) == 7 );
+        CHECK( heap.Reset( true ) == 0 );
+
+        heap.Allocate( 100 );
+        CHECK( heap.Reset( false ) == 0 );
+        CHECK( heap.GetStats().numAllocations == 0 );
+#else
+        printf( "  DEBUG_ASSERT is on, skipped\n" );
+#endif
+    }
+
+
+    // the out of band allocator only takes pointers inside the memory it
+    // manages. ones outside it, even where their offset from the base
+    // would wrap onto a block, are ignored. with nothing to manage, Init
+    // fails and every allocation does too
+    void TestOutOfBandPointers( )
+    {
+        static u64 s_memory[ 4096 / sizeof( u64 ) ];
+        OutOfBandFreeListAllocator heap( s_memory, sizeof( s_memory ), 16 );
+        CHECK( heap.IsInitialized() );
+
+        byte* first = ( byte* )heap.Allocate( 64 );
+        byte* second = ( byte* )heap.Allocate( 64 );
+        CHECK( first == ( byte* )s_memory && second == first + 64 );
+
+#if defined( NDEBUG )
+        if( sizeof( size_t ) > 4 )
+        {
+            // 4 GiB above the first block truncates to its offset
+            heap.Free( ( void* )( ( size_t )first + ( ( ( size_t )1 << 16 ) << 16 ) ) );
+        }
+
+        heap.Free( first - 64 );
+        heap.Free( first + sizeof( s_memory ) );
+        heap.Free( first + 8 );
+        CHECK( heap.GetBlockSize( first ) == 64 );
+        CHECK( heap.GetBlockSize( first + sizeof( s_memory ) ) == 0 );
+#endif
+
+        heap.Free( first );
+        CHECK( heap.Allocate( 64 ) == first );
+        heap.Reset();
+
+        OutOfBandFreeListAllocator empty( NULL, 4096, 16 );
+        CHECK( !empty.IsInitialized() );
+        CHECK( empty.Allocate( 64 ) == NULL );
+        empty.Reset();
+        CHECK( empty.Allocate( 64 ) == NULL );
+    }
+
+
+    // trace events carry the tag of the block, so a block freed while
+    // another tag is current is recorded under the tag it was allocated
+    // with, on both events
+    void TestTraceBlockTags( )
+    {
+        const char* path = "FreeListAllocatorTests.trace";
+        const memtag_t allocTag = 5;
+        const memtag_t otherTag = 9;
+
+        {
+            AllocTraceRecorder recorder;
+            CHECK( recorder.Start( path ) );
+
+            TracedHeap heap( HEAP_SIZE );
+            heap.GetStatsPolicy().SetRecorder( &recorder );
+
+            void* tagged = heap.AllocateAligned( 100, ALIGN_8, allocTag );
+            void* current = NULL;
+
+            {
+                ScopedMemTag scope( otherTag );
+                current = heap.Allocate( 100 );
+                heap.Free( tagged );
+            }
+
+            heap.Free( current );
+            recorder.Stop();
+        }
+
+        FILE* file = fopen( path, "rb" );
+        CHECK( file != NULL );
+
+        if( file == NULL )
+        {
+            return;
+        }
+
+        alloc_trace_header_s header;
+        alloc_trace_event_s events[ 4 ];
+
+        CHECK( fread( &header, sizeof( header ), 1, file ) == 1 );
+        CHECK( fread( events, sizeof( events[ 0 ] ), 4, file ) == 4 );
+        fclose( file );
+        remove( path );
+
+        CHECK( events[ 0 ].type == ALLOC_TRACE_ALLOCATE && events[ 0 ].tag == allocTag );
+        CHECK( events[ 1 ].type == ALLOC_TRACE_ALLOCATE && events[ 1 ].tag == otherTag );
+        CHECK( events[ 2 ].type == ALLOC_TRACE_FREE && events[ 2 ].tag == allocTag );
+        CHECK( events[ 3 ].type == ALLOC_TRACE_FREE && events[ 3 ].tag == otherTag );
+    }
+
+
+    // the shadow bitmap only accepts pointers to the start of a block in
+    // use, so foreign and interior pointers and blocks that were already
+    // freed are all rejected. Free ignores the pointers it rejects and
+    // counts them, but fails a debug assertion first, so that half only
+    // runs where those are compiled out
+    void TestInvalidPointers( )
+    {
+        CheckedHeap heap( HEAP_SIZE );
+        const ShadowBitmapDebugPolicy& debug = heap.GetDebugPolicy();
+
+        u64 local = 0;
+        byte* a = ( byte* )heap.Allocate( 100 );
+        byte* b = ( byte* )heap.Allocate( 100 );
+        byte* c = ( byte* )heap.Allocate( 100 );
+
+        CHECK( debug.IsValidBlock( a ) && debug.IsValidBlock( b ) && debug.IsValidBlock( c ) );
+        CHECK( !debug.IsValidBlock( &local ) );
+        CHECK( !debug.IsValidBlock( b + 8 ) );
+        CHECK( !debug.IsValidBlock( b + 1 ) );
+        CHECK( !debug.IsValidBlock( ( byte* )heap.GetHeapBase() + heap.GetHeapSize() ) );
+        CHECK( !debug.IsValidBlock( ( byte* )heap.GetHeapBase() - 8 ) );
+
+        // b is coalesced into a, so its header is no longer a block
+        heap.Free( a );
+        heap.Free( b );
+        CHECK( !debug.IsValidBlock( a ) && !debug.IsValidBlock( b ) );
+        CHECK( debug.GetInvalidPointerCount() == 0 );
+
+#if defined( NDEBUG )
+        heap_stats_s before = heap.GetStats();
+
+        heap.Free( a );
+        heap.Free( b );
+        heap.Free( b, 104 );
+        heap.Free( c + 8 );
+        heap.Free( &local );
+
+        CHECK( debug.GetInvalidPointerCount() == 5 );
+        CHECK( heap.GetBlockSize( b ) == 0 );
+        CHECK( heap.Verify( 0xFFFFFFFFu ) );
+
+        heap_stats_s after = heap.GetStats();
+        CHECK( after.bytesInUse == before.bytesInUse );
+        CHECK( after.bytesFree == before.bytesFree );
+        CHECK( after.freeBlockCount == before.freeBlockCount );
+
+        // the rejected frees left c alone
+        CHECK( debug.IsValidBlock( c ) );
+        heap.Free( c );
+        CHECK( heap.GetStats().numAllocations == 0 );
+#else
+        heap.Free( c );
+        printf( "  DEBUG_ASSERT is on, frees not checked\n" );
+#endif
+    }
+
+
+    // the level 1 canary lives in the in use block's tag word, so the
+    // header stays the size of block_s and tags read back unchanged. a
+    // header overwritten by the block in front of it is caught on Free,
+    // which leaks the block instead of linking a bad header into the
+    // free list. that also fails a debug assertion, so that half only
+    // runs where those are compiled out
+    void TestHeaderCanary( )
+    {
+        static_assert( CanaryHeap::ALIGNED_HEADER_SIZE == FirstFitHeap::ALIGNED_HEADER_SIZE, "Canary takes header space" );
+
+        CanaryHeap heap( HEAP_SIZE );
+        const TieredDebugPolicy< 1 >& debug = heap.GetDebugPolicy();
+
+        byte* a = ( byte* )heap.AllocateAligned( 120, ALIGN_8, 7 );
+        byte* b = ( byte* )heap.AllocateAligned( 120, ALIGN_8, 63 );
+        byte* c = ( byte* )heap.AllocateAligned( 120, ALIGN_8, 0 );
+
+        CHECK( heap.GetBlockTag( a ) == 7 && heap.GetBlockTag( b ) == 63 && heap.GetBlockTag( c ) == 0 );
+        CHECK( heap.GetBlockSize( b ) == 120 );
+        CHECK( debug.GetHeaderCanary( a, 120 ) != 0 );
+        CHECK( debug.GetHeaderCanary( a, 120 ) != debug.GetHeaderCanary( b, 120 ) );
+        CHECK( debug.IsIntactBlock( b, 120, CanaryHeap::GetHeaderCanary( CanaryHeap::GetBlock( b ) ) ) );
+
+        heap.Free( a );
+        CHECK( heap.GetStats().numAllocations == 2 );
+
+#if defined( NDEBUG )
+        // run off the end of c into the header of the free block after it
+        // is not checked, but off the end of b into c's header is
+        memset( b, 0xAB, 120 + 4 );
+        CHECK( heap.GetBlockSize( c ) == 0 );
+
+        heap.Free( c );
+        CHECK( debug.GetInvalidPointerCount() == 1 );
+        CHECK( heap.GetStats().numAllocations == 2 );
+
+        heap.Free( b );
+        CHECK( heap.GetStats().numAllocations == 1 );
+        CHECK( heap.Verify( 0xFFFFFFFFu ) );
+#else
+        heap.Free( b );
+        heap.Free( c );
+        CHECK( heap.GetStats().numAllocations == 0 );
+        printf( "  DEBUG_ASSERT is on, corruption not checked\n" );
+#endif
+    }
+
+
+    // TrimPagePolicy gives back the pages of large free blocks on Free,
+    // or all of them on Trim when Free is set not to, and takes pages
+    // back as resident as soon as they are allocated again. a new heap
+    // has never been touched, so it starts out all given back. the page
+    // with the first block header in it is never given back
+    void TestTrimPages( )
+    {
+#if defined( __linux__ )
+        const u32 blockSize = 1u << 20;
+        const u32 slack = 64 * 1024;
+
+        TrimHeap heap( 4 * blockSize );
+        TrimPagePolicy& pages = heap.GetPagePolicy();
+
+        u32 untouched = pages.GetReleasedBytes();
+        CHECK( untouched >= 4 * blockSize );
+
+        // on Free
+        byte* block = ( byte* )heap.Allocate( blockSize );
+        memset( block, 0xAB, blockSize );
+
+        u32 resident = pages.GetReleasedBytes();
+        CHECK( untouched - resident >= blockSize );
+
+        heap.Free( block );
+        CHECK( pages.GetReleasedBytes() + slack >= untouched );
+
+        // given back pages read back as zeros once allocated again
+        block = ( byte* )heap.Allocate( blockSize );
+        CHECK( pages.GetReleasedBytes() == resident );
+        CHECK( block[ blockSize / 2 ] == 0 );
+        memset( block, 0xAB, blockSize );
+
+        // on Trim only
+        pages.SetMinTrimBytes( 0xFFFFFFFFu );
+        heap.Free( block );
+        CHECK( pages.GetReleasedBytes() == resident );
+
+        u32 trimmed = heap.Trim();
+        CHECK( trimmed + slack >= blockSize );
+        CHECK( pages.GetReleasedBytes() == resident + trimmed );
+        CHECK( heap.Trim() == 0 );
+        CHECK( heap.Verify( 0xFFFFFFFFu ) );
+#else
+        printf( "  no madvise, skipped\n" );
+#endif
+    }
+
+
+    // the next fit rover is a free block, so when a block freed in front
+    // of it absorbs it, the rover has to move to the joined block. the
+    // absorbed header is filled with FREED_FILL, so a rover left behind
+    // would send the next search through garbage
+    void TestNextFitRoverCoalesce( )
+    {
+        NextFitHeap heap( HEAP_SIZE );
+        NextFitPolicy& fit = heap.GetFitPolicy();
+
+        byte* a = ( byte* )heap.Allocate( 96 );
+        byte* r = ( byte* )heap.Allocate( 96 );
+        byte* b = ( byte* )heap.Allocate( 96 );
+        byte* c = ( byte* )heap.Allocate( 1024 );
+        byte* d = ( byte* )heap.Allocate( 96 );
+
+        heap.Free( r );
+        heap.Free( c );
+
+        // r's block is too small, so this comes from c's and leaves the
+        // rover on r's
+        byte* first = ( byte* )heap.Allocate( 512 );
+        CHECK( first == c );
+        CHECK( fit.GetRover() == NextFitHeap::GetBlock( r ) );
+
+        // r's block is joined onto a's
+        heap.Free( a );
+        CHECK( fit.GetRover() == NextFitHeap::GetBlock( a ) );
+        CHECK( heap.Verify( 0xFFFFFFFFu ) );
+
+        // the search carries on after the joined block, with what is left
+        // of c's block
+        byte* second = ( byte* )heap.Allocate( 256 );
+        CHECK( second > first && second < d );
+        CHECK( fit.GetRover() == NextFitHeap::GetBlock( a ) );
+
+        byte* third = ( byte* )heap.Allocate( 160 );
+        CHECK( third > second && third < d );
+        CHECK( heap.Verify( 0xFFFFFFFFu ) );
+
+        heap.Free( b );
+        heap.Free( third );
+        heap.Free( second );
+        heap.Free( first );
+        heap.Free( d );
+
+        CHECK( heap.GetNext( heap.GetFirstFree() ) == NULL );
+
+        heap.Reset();
+        CHECK( fit.GetRover() == NULL );
+    }
+
+
+    struct test_s
+    {
+        const char* name;
+        void        ( *func )( );
+    };
+
+    const test_s TESTS[] =
+    {
+        { "TopChunkBump",           TestTopChunkBump },
+        { "TopChunkCoalesce",       TestTopChunkCoalesce },
+        { "TopChunkAbsorbed",       TestTopChunkAbsorbed },
+        { "TopChunkExhausted",      TestTopChunkExhausted },
+        { "TopChunkUnused",         TestTopChunkUnused },
+        { "TopChunkGrow",           TestTopChunkGrow },
+        { "TopChunkReset",          TestTopChunkReset },
+        { "TopChunkRandom",         TestTopChunkRandom },
+        { "HeapWalkCoalesce",       TestHeapWalkCoalesce },
+        { "HeapWalkRandom",         TestHeapWalkRandom },
+        { "VerifyAcrossChanges",    TestVerifyAcrossChanges },
+        { "VerifyFindsCorruption",  TestVerifyFindsCorruption },
+        { "ImageRestore",           TestImageRestore },
+        { "SizedFree",              TestSizedFree },
+        { "Reset",                  TestReset },
+        { "ResetLiveBlocks",        TestResetLiveBlocks },
+        { "OutOfBandPointers",      TestOutOfBandPointers },
+        { "TraceBlockTags",         TestTraceBlockTags },
+        { "InvalidPointers",        TestInvalidPointers },
+        { "HeaderCanary",           TestHeaderCanary },
+        { "TrimPages",              TestTrimPages },
+        { "ImageCanaries",          TestImageCanaries },
+        { "NextFitRoverCoalesce",   TestNextFitRoverCoalesce },
+    };
+}
+
+
+int main( )
+{
+    u32 failedTests = 0;
+
+    for( size_t i = 0; i < sizeof( TESTS ) / sizeof( TESTS[ 0 ] ); ++i )
+    {
+        u32 failures = s_failures;
+
+        printf( "%s\n", TESTS[ i ].name );
+        TESTS[ i ].func();
+
+        if( s_failures != failures )
+        {
+            ++failedTests;
+        }
+    }
+
+    printf( "%u of %u tests failed\n", failedTests, ( u32 )( sizeof( TESTS ) / sizeof( TESTS[ 0 ] ) ) );
+
+    return failedTests ? 1 : 0;
+}
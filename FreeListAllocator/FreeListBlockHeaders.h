@@ -0,0 +1,103 @@
+#ifndef _BB_FREELIST_BLOCK_HEADERS_H_ // [ _BB_FREELIST_BLOCK_HEADERS_H_
+#define _BB_FREELIST_BLOCK_HEADERS_H_
+
+#include "engine/system/System.h"
+
+namespace bbengine
+{
+    namespace mem
+    {
+        /*====================================================================
+
+            Block header layouts for BasicFreeListAllocator. Both layouts
+            keep the size and "free" flag in a u32 and only differ in how
+            the link to the next free block is stored. base is the start of
+            the heap the block lives in.
+
+            blocks that are in use are not linked into the free list, so
+            their next field holds the block's memory tag instead, with the
+            DebugPolicy's header canary, if any, in the bits above it.
+
+        ====================================================================*/
+
+
+        // stores next as a pointer. 8 bytes on 32-bit targets but padded out
+        // to 16 bytes on 64-bit targets
+        class PointerBlockHeader
+        {
+        public:
+            struct block_s
+            {
+                block_s*    next;
+                u32         size;   // lowest order bit used as a "free" flag. since
+                                    // sizes are only ever going to be 8 byte aligned
+                                    // there will be unused lower order bits. bit
+                                    // is set to 1 if in use and 0 if free
+            };
+
+            static block_s* GetNext( const byte* base, const block_s* block )
+            {
+                ( void )base;
+                return block->next;
+            }
+
+            static void SetNext( const byte* base, block_s* block, block_s* next )
+            {
+                ( void )base;
+                block->next = next;
+            }
+
+            static u32 GetTag( const block_s* block )           { return ( u32 )( size_t )block->next; }
+            static void SetTag( block_s* block, u32 tag )       { block->next = ( block_s* )( size_t )tag; }
+        };
+
+
+        // stores next as a byte offset from the start of the heap, keeping
+        // the header at 8 bytes regardless of pointer size. heap sizes are
+        // u32 so any block in the heap can be reached with an offset
+        class OffsetBlockHeader
+        {
+        public:
+            struct block_s
+            {
+                u32         next;   // offset from the heap base, NULL_OFFSET for none
+                u32         size;   // same layout as PointerBlockHeader::block_s::size
+            };
+
+            static const u32 NULL_OFFSET = 0xFFFFFFFFu;
+
+            static block_s* GetNext( const byte* base, const block_s* block )
+            {
+                return block->next == NULL_OFFSET ? NULL : ( block_s* )( base + block->next );
+            }
+
+            static void SetNext( const byte* base, block_s* block, block_s* next )
+            {
+                block->next = next ? ( u32 )( ( byte* )next - base ) : NULL_OFFSET;
+            }
+
+            static u32 GetTag( const block_s* block )           { return block->next; }
+            static void SetTag( block_s* block, u32 tag )       { block->next = tag; }
+        };
+
+
+        // picks the smallest header for the target. pointers are only worth
+        // storing directly when they are no bigger than an offset
+        template< bool WIDE_POINTERS >
+        struct SelectBlockHeader
+        {
+            typedef PointerBlockHeader type;
+        };
+
+        template<>
+        struct SelectBlockHeader< true >
+        {
+            typedef OffsetBlockHeader type;
+        };
+
+        typedef SelectBlockHeader< ( sizeof( void* ) > sizeof( u32 ) ) >::type DefaultBlockHeader;
+    }
+}
+
+
+#endif // ] _BB_FREELIST_BLOCK_HEADERS_H_
@@ -0,0 +1,52 @@
+#include "engine/memory/FreeListDebug.h"
+
+#if defined( __unix__ ) || defined( __APPLE__ )
+    #include <sys/mman.h>
+    #include <unistd.h>
+    #define BB_HAS_MPROTECT 1
+#endif
+
+namespace bbengine
+{
+    namespace mem
+    {
+        /*====================================================================
+
+            DebugPages_Protect( void* start, u32 size, bool noAccess )
+            - protects every whole page in the range. partial pages at
+              either end are left alone, since they are shared with block
+              headers the allocator still has to reach
+            - unprotects every page the range touches, since any of them may
+              have been protected as part of a larger range
+
+        ====================================================================*/
+        void DebugPages_Protect( void* start, u32 size, bool noAccess )
+        {
+#if defined( BB_HAS_MPROTECT )
+            static const size_t pageSize = ( size_t )sysconf( _SC_PAGESIZE );
+
+            size_t first = ( size_t )start;
+            size_t last = ( size_t )start + size;
+
+            if( noAccess )
+            {
+                first = ( first + pageSize - 1 ) & ~( pageSize - 1 );
+                last = last & ~( pageSize - 1 );
+            }
+            else
+            {
+                first = first & ~( pageSize - 1 );
+                last = ( last + pageSize - 1 ) & ~( pageSize - 1 );
+            }
+
+            if( first < last )
+            {
+                // failure ( ie running out of mappings ) only loses protection
+                mprotect( ( void* )first, last - first, noAccess ? PROT_NONE : PROT_READ | PROT_WRITE );
+            }
+#else
+            ( void )start; ( void )size; ( void )noAccess;
+#endif
+        }
+    }
+}
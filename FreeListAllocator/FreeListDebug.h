@@ -0,0 +1,326 @@
+#ifndef _BB_FREELIST_DEBUG_H_ // [ _BB_FREELIST_DEBUG_H_
+#define _BB_FREELIST_DEBUG_H_
+
+#include "engine/system/Assert.h"
+#include "engine/memory/FreeListPolicies.h"
+#include <stdlib.h>
+
+namespace bbengine
+{
+    namespace mem
+    {
+        // DebugPolicy that keeps a shadow bitmap with one bit per 8-byte
+        // granule of the heap, set for the first byte of every block in
+        // use. a pointer is only valid if it is inside the heap, 8-byte
+        // aligned and its bit is set, so foreign pointers, pointers into
+        // the middle of a block and pointers that were already freed are
+        // all rejected in constant time, without reading the block header.
+        // the bitmap is heapSize / 64 bytes and is allocated with malloc
+        class ShadowBitmapDebugPolicy : public NullDebugPolicy
+        {
+        public:
+            ShadowBitmapDebugPolicy( )
+                : m_heap( NULL ), m_heapSize( 0 ), m_bitmap( NULL ), m_invalidPointers( 0 )
+            {
+            }
+
+            ~ShadowBitmapDebugPolicy( )
+            {
+                free( m_bitmap );
+            }
+
+            void OnInit( void* heap, u32 heapSize )
+            {
+                m_heap = ( byte* )heap;
+                m_heapSize = heapSize;
+
+                free( m_bitmap );
+                m_bitmap = ( u64* )calloc( GetWordCount(), sizeof( u64 ) );
+            }
+
+            void OnAllocate( void* ptr, u32 blockSize )
+            {
+                ( void )blockSize;
+
+                u32 granule = GetGranule( ptr );
+                m_bitmap[ granule >> 6 ] |= 1ull << ( granule & 63 );
+            }
+
+            void OnRestoreBlock( void* ptr, u32 blockSize )
+            {
+                OnAllocate( ptr, blockSize );
+            }
+
+            void OnFree( void* ptr, u32 blockSize )
+            {
+                ( void )blockSize;
+
+                u32 granule = GetGranule( ptr );
+                m_bitmap[ granule >> 6 ] &= ~( 1ull << ( granule & 63 ) );
+            }
+
+            void OnReset( )
+            {
+                memset( m_bitmap, 0, GetWordCount() * sizeof( u64 ) );
+            }
+
+            // @return: true if ptr was handed out by the allocator and has
+            // not been freed since
+            bool IsValidBlock( const void* ptr ) const
+            {
+                size_t offset = ( size_t )( ( const byte* )ptr - m_heap );
+
+                if( offset >= m_heapSize || ( offset & 7 ) || m_bitmap == NULL )
+                {
+                    return false;
+                }
+
+                u32 granule = ( u32 )( offset >> 3 );
+                return ( m_bitmap[ granule >> 6 ] >> ( granule & 63 ) ) & 1;
+            }
+
+            // called when Free or GetBlockSize rejects a pointer
+            void OnInvalidPointer( const void* ptr )
+            {
+                ( void )ptr;
+                ++m_invalidPointers;
+            }
+
+            // number of pointers rejected since construction, for QA reports
+            u32 GetInvalidPointerCount( ) const     { return m_invalidPointers; }
+
+        private:
+            ShadowBitmapDebugPolicy( ShadowBitmapDebugPolicy& );
+
+            u32 GetGranule( const void* ptr ) const { return ( u32 )( ( ( const byte* )ptr - m_heap ) >> 3 ); }
+            u32 GetWordCount( ) const               { return ( ( m_heapSize >> 3 ) + 63 ) >> 6; }
+
+            byte*   m_heap;
+            u32     m_heapSize;
+            u64*    m_bitmap;           // bit per 8 bytes of m_heap
+            u32     m_invalidPointers;
+        };
+
+
+        // page protection for TieredDebugPolicy. noAccess makes the whole
+        // pages inside [ start, start + size ) fault on any access, otherwise
+        // every page the range touches is made read / write again. does
+        // nothing on targets without mprotect
+        void DebugPages_Protect( void* start, u32 size, bool noAccess );
+
+
+        /*====================================================================
+
+            TieredDebugPolicy< LEVEL >
+            - DebugPolicy with a cost that goes up with LEVEL, so QA can run
+              cheaply most of the time and step up once a corruption shows
+            - 0: nothing
+            - 1: a 16-bit header canary, made from the block's offset in the
+              heap and its size. the allocator keeps it in the in use
+              block's tag word, above the tag, so it costs no header space
+              and still matches when the heap is mapped at another address.
+              Free and GetBlockSize reject blocks whose canary no longer
+              matches, which catches overruns of the block before it and
+              underruns of the block that reach its header
+            - 2: blocks are filled with ALLOCATED_FILL when allocated and
+              FREED_FILL when freed. free space is checked for FREED_FILL
+              when it is allocated again, which catches writes after free
+            - 3: whole pages of free space are protected with mprotect, so
+              reads and writes after free fault at the instruction that made
+              them. every Free and split costs a system call, and each
+              protected range is a separate mapping, so keep to small heaps
+
+        ====================================================================*/
+        template< u32 LEVEL >
+        class TieredDebugPolicy : public NullDebugPolicy
+        {
+        public:
+            static const bool USES_HEADER_CANARY = LEVEL >= 1;
+            static const bool CHECKS_FREE_SPACE = LEVEL >= 2;
+
+            static const byte ALLOCATED_FILL    = 0xCD;
+            static const byte FREED_FILL        = 0xDD;
+
+            TieredDebugPolicy( )
+                : m_heap( NULL ), m_committed( 0 ), m_invalidPointers( 0 ), m_corruptions( 0 )
+            {
+            }
+
+            void OnInit( void* heap, u32 heapSize )
+            {
+                ( void )heapSize;
+
+                m_heap = heap;
+                m_committed = 0;
+            }
+
+            void OnCommit( void* start, u32 size )
+            {
+                if( LEVEL >= 2 )
+                {
+                    memset( start, FREED_FILL, size );
+                }
+
+                m_committed = ( u32 )( ( byte* )start + size - ( byte* )m_heap );
+            }
+
+            // restored memory keeps its fill patterns
+            void OnRestore( void* start, u32 size )
+            {
+                m_committed = ( u32 )( ( byte* )start + size - ( byte* )m_heap );
+            }
+
+            void OnRelease( )
+            {
+                if( LEVEL >= 3 )
+                {
+                    DebugPages_Protect( m_heap, m_committed, false );
+                }
+            }
+
+            void OnReset( )
+            {
+                OnRelease();
+                OnCommit( m_heap, m_committed );
+            }
+
+            void OnAllocate( void* ptr, u32 blockSize )
+            {
+                if( LEVEL >= 2 )
+                {
+                    // blocks are 8-byte aligned and sized
+                    const u64 freed = 0x0101010101010101ull * FREED_FILL;
+                    const u64* words = ( const u64* )ptr;
+
+                    for( u32 i = 0; i < blockSize / sizeof( u64 ); ++i )
+                    {
+                        if( words[ i ] != freed )
+                        {
+                            ++m_corruptions;
+                            DEBUG_ASSERT( false && "Free memory was written to after it was freed" );
+                            break;
+                        }
+                    }
+
+                    memset( ptr, ALLOCATED_FILL, blockSize );
+                }
+            }
+
+            void OnFree( void* ptr, u32 blockSize )
+            {
+                if( LEVEL >= 2 )
+                {
+                    memset( ptr, FREED_FILL, blockSize );
+                }
+            }
+
+            void OnFreeSpace( void* start, u32 size )
+            {
+                if( LEVEL >= 3 )
+                {
+                    DebugPages_Protect( start, size, true );
+                }
+            }
+
+            void OnReuseFreeSpace( void* start, u32 size )
+            {
+                if( LEVEL >= 3 )
+                {
+                    DebugPages_Protect( start, size, false );
+                }
+            }
+
+            void OnHeaderAbsorbed( void* header, u32 size )
+            {
+                if( LEVEL >= 2 )
+                {
+                    memset( header, FREED_FILL, size );
+                }
+            }
+
+            // never 0, which is left to mean no canary
+            u32 GetHeaderCanary( const void* ptr, u32 blockSize ) const
+            {
+                if( LEVEL < 1 )
+                {
+                    return 0;
+                }
+
+                u32 offset = ( u32 )( ( const byte* )ptr - ( const byte* )m_heap );
+                u32 hash = ( offset * 0x9E3779B1u ) ^ ( blockSize * 0x85EBCA6Bu ) ^ 0xBBCA7A2Eu;
+                hash ^= hash >> 15;
+                hash *= 0x2C1B3C6Du;
+
+                u32 canary = hash >> 16;
+                return canary ? canary : 1;
+            }
+
+            bool IsIntactBlock( const void* ptr, u32 blockSize, u32 canary ) const
+            {
+                return LEVEL < 1 || canary == GetHeaderCanary( ptr, blockSize );
+            }
+
+            void OnInvalidPointer( const void* ptr )
+            {
+                ( void )ptr;
+                ++m_invalidPointers;
+            }
+
+            // pointers rejected by Free, and use after free writes found, since
+            // construction
+            u32 GetInvalidPointerCount( ) const     { return m_invalidPointers; }
+            u32 GetCorruptionCount( ) const         { return m_corruptions; }
+
+        private:
+            void*   m_heap;
+            u32     m_committed;        // bytes from m_heap that are usable memory
+            u32     m_invalidPointers;
+            u32     m_corruptions;
+        };
+
+
+        // runs two DebugPolicies side by side. every hook goes to both and a
+        // pointer has to pass both policies' checks. at most one of them
+        // may use a header canary
+        template< class First, class Second >
+        class DebugPolicyPair
+        {
+        public:
+            static const bool USES_HEADER_CANARY = First::USES_HEADER_CANARY || Second::USES_HEADER_CANARY;
+            static const bool CHECKS_FREE_SPACE = First::CHECKS_FREE_SPACE || Second::CHECKS_FREE_SPACE;
+
+            static_assert( !First::USES_HEADER_CANARY || !Second::USES_HEADER_CANARY, "Only one DebugPolicy can use the header canary" );
+
+            void OnInit( void* heap, u32 heapSize )         { m_first.OnInit( heap, heapSize ); m_second.OnInit( heap, heapSize ); }
+            void OnCommit( void* start, u32 size )          { m_first.OnCommit( start, size ); m_second.OnCommit( start, size ); }
+            void OnRestore( void* start, u32 size )         { m_first.OnRestore( start, size ); m_second.OnRestore( start, size ); }
+            void OnRestoreBlock( void* ptr, u32 blockSize ) { m_first.OnRestoreBlock( ptr, blockSize ); m_second.OnRestoreBlock( ptr, blockSize ); }
+            void OnRelease( )                               { m_first.OnRelease(); m_second.OnRelease(); }
+            void OnAllocate( void* ptr, u32 blockSize )     { m_first.OnAllocate( ptr, blockSize ); m_second.OnAllocate( ptr, blockSize ); }
+            void OnFree( void* ptr, u32 blockSize )         { m_first.OnFree( ptr, blockSize ); m_second.OnFree( ptr, blockSize ); }
+            void OnReset( )                                 { m_first.OnReset(); m_second.OnReset(); }
+
+            void OnFreeSpace( void* start, u32 size )       { m_first.OnFreeSpace( start, size ); m_second.OnFreeSpace( start, size ); }
+            void OnReuseFreeSpace( void* start, u32 size )  { m_first.OnReuseFreeSpace( start, size ); m_second.OnReuseFreeSpace( start, size ); }
+            void OnHeaderAbsorbed( void* header, u32 size ) { m_first.OnHeaderAbsorbed( header, size ); m_second.OnHeaderAbsorbed( header, size ); }
+
+            bool IsValidBlock( const void* ptr ) const                  { return m_first.IsValidBlock( ptr ) && m_second.IsValidBlock( ptr ); }
+            u32  GetHeaderCanary( const void* ptr, u32 blockSize ) const    { return m_first.GetHeaderCanary( ptr, blockSize ) | m_second.GetHeaderCanary( ptr, blockSize ); }
+            bool IsIntactBlock( const void* ptr, u32 blockSize, u32 canary ) const
+            {
+                return m_first.IsIntactBlock( ptr, blockSize, canary ) && m_second.IsIntactBlock( ptr, blockSize, canary );
+            }
+            void OnInvalidPointer( const void* ptr )                    { m_first.OnInvalidPointer( ptr ); m_second.OnInvalidPointer( ptr ); }
+
+            First&  GetFirst( )                             { return m_first; }
+            Second& GetSecond( )                            { return m_second; }
+
+        private:
+            First   m_first;
+            Second  m_second;
+        };
+    }
+}
+
+
+#endif // ] _BB_FREELIST_DEBUG_H_
@@ -0,0 +1,418 @@
+#include "engine/memory/FreeListPages.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#if defined( __unix__ ) || defined( __APPLE__ )
+    #include <sys/mman.h>
+    #include <unistd.h>
+    #define BB_HAS_MMAP 1
+    #define BB_HAS_MADVISE 1
+#endif
+
+#if defined( __linux__ )
+    #define BB_HAS_HUGE_PAGES 1
+#endif
+
+namespace bbengine
+{
+    namespace mem
+    {
+        /*====================================================================
+
+            HeapPages_Map( u32 size, u32 flags, heap_mapping_s& mapping )
+            - rounds size up to whole pages, or whole huge pages. an explicit
+              MAP_HUGETLB mapping reserves its pages up front, so it either
+              fails here or is fully backed
+            - otherwise maps an extra huge page and unmaps the unaligned
+              ends, so the transparent huge pages can line up with the heap
+            - a reserved mapping has no access and no commit charge until
+              HeapPages_Commit is called on it. reserving only needs mmap and
+              mprotect, so it works on every POSIX target, while huge pages
+              are only asked for on Linux
+
+        ====================================================================*/
+        bool HeapPages_Map( u32 size, u32 flags, heap_mapping_s& mapping )
+        {
+            mapping.base = NULL;
+            mapping.size = 0;
+            mapping.committed = 0;
+            mapping.granularity = 0;
+            mapping.explicitHuge = false;
+
+#if defined( BB_HAS_MMAP )
+    #if !defined( BB_HAS_HUGE_PAGES )
+            flags &= ~HEAP_HUGE_PAGES;
+    #endif
+
+            if( ( flags & ( HEAP_HUGE_PAGES | HEAP_RESERVE ) ) == 0 )
+            {
+                return false;
+            }
+
+            bool huge = ( flags & HEAP_HUGE_PAGES ) != 0;
+            bool reserve = ( flags & HEAP_RESERVE ) != 0;
+            u64 alignment = huge ? HUGE_PAGE_SIZE : ( u64 )sysconf( _SC_PAGESIZE );
+            u64 mapSize = ( ( u64 )size + alignment - 1 ) & ~( alignment - 1 );
+
+            mapping.granularity = huge && HUGE_PAGE_SIZE > MIN_COMMIT_SIZE ? ( u32 )HUGE_PAGE_SIZE : MIN_COMMIT_SIZE;
+
+    #if defined( MAP_HUGETLB )
+            if( huge && !reserve )
+            {
+                void* base = mmap( NULL, mapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0 );
+
+                if( base != MAP_FAILED )
+                {
+                    mapping.base = base;
+                    mapping.size = mapSize;
+                    mapping.committed = mapSize;
+                    mapping.explicitHuge = true;
+                    return true;
+                }
+            }
+    #endif
+
+    #if defined( MAP_NORESERVE )
+            int reserveFlags = reserve ? MAP_NORESERVE : 0;
+    #else
+            int reserveFlags = 0;
+    #endif
+
+            u64 extra = huge ? HUGE_PAGE_SIZE : 0;
+            byte* region = ( byte* )mmap( NULL, mapSize + extra, reserve ? PROT_NONE : PROT_READ | PROT_WRITE,
+                                          MAP_PRIVATE | MAP_ANONYMOUS | reserveFlags, -1, 0 );
+
+            if( region == MAP_FAILED )
+            {
+                return false;
+            }
+
+            byte* aligned = region;
+
+            if( huge )
+            {
+                aligned = ( byte* )( ( ( size_t )region + HUGE_PAGE_SIZE - 1 ) & ~( size_t )( HUGE_PAGE_SIZE - 1 ) );
+                size_t head = ( size_t )( aligned - region );
+                size_t tail = ( size_t )HUGE_PAGE_SIZE - head;
+
+                if( head )
+                {
+                    munmap( region, head );
+                }
+
+                if( tail )
+                {
+                    munmap( aligned + mapSize, tail );
+                }
+
+    #if defined( MADV_HUGEPAGE )
+                // only a hint. with transparent huge pages disabled this fails
+                // and the heap is left on normal pages
+                madvise( aligned, mapSize, MADV_HUGEPAGE );
+    #endif
+            }
+
+            mapping.base = aligned;
+            mapping.size = mapSize;
+            mapping.committed = reserve ? 0 : mapSize;
+
+            if( reserve && !HeapPages_Commit( mapping, 0 ) )
+            {
+                HeapPages_Unmap( mapping );
+                return false;
+            }
+
+            return true;
+#else
+            ( void )size; ( void )flags;
+            return false;
+#endif
+        }
+
+
+        /*====================================================================
+
+            HeapPages_Unmap( heap_mapping_s& mapping )
+
+        ====================================================================*/
+        void HeapPages_Unmap( heap_mapping_s& mapping )
+        {
+#if defined( BB_HAS_MMAP )
+            if( mapping.base )
+            {
+                munmap( mapping.base, mapping.size );
+            }
+#endif
+
+            mapping.base = NULL;
+            mapping.size = 0;
+            mapping.committed = 0;
+        }
+
+
+        /*====================================================================
+
+            HeapPages_Commit( heap_mapping_s& mapping, u32 size )
+            - makes the next pages after the committed part of the mapping
+              read / write. the commit is clamped to the mapping and to the
+              largest heap size a u32 can hold
+
+        ====================================================================*/
+        bool HeapPages_Commit( heap_mapping_s& mapping, u32 size )
+        {
+#if defined( BB_HAS_MMAP )
+            u64 limit = mapping.size < 0xFFFFFFFFull ? mapping.size : 0xFFFFFFFFull & ~( ( u64 )mapping.granularity - 1 );
+            u64 commitSize = ( ( u64 )size + mapping.granularity - 1 ) & ~( ( u64 )mapping.granularity - 1 );
+
+            if( commitSize == 0 )
+            {
+                commitSize = mapping.granularity;
+            }
+
+            if( mapping.committed + commitSize > limit )
+            {
+                commitSize = limit - mapping.committed;
+            }
+
+            if( mapping.base == NULL || commitSize == 0 )
+            {
+                return false;
+            }
+
+            if( mprotect( ( byte* )mapping.base + mapping.committed, commitSize, PROT_READ | PROT_WRITE ) != 0 )
+            {
+                return false;
+            }
+
+            mapping.committed += commitSize;
+            return true;
+#else
+            ( void )mapping; ( void )size;
+            return false;
+#endif
+        }
+
+
+        /*====================================================================
+
+            HeapPages_CountHuge( const heap_mapping_s& mapping )
+            - explicit mappings are all huge pages. for transparent huge
+              pages, reads the AnonHugePages line of the mapping's entry in
+              /proc/self/smaps
+
+        ====================================================================*/
+        u32 HeapPages_CountHuge( const heap_mapping_s& mapping )
+        {
+            if( mapping.base == NULL )
+            {
+                return 0;
+            }
+
+            if( mapping.explicitHuge )
+            {
+                return ( u32 )( mapping.size / HUGE_PAGE_SIZE );
+            }
+
+            u64 hugeBytes = 0;
+
+#if defined( BB_HAS_HUGE_PAGES )
+            FILE* smaps = fopen( "/proc/self/smaps", "r" );
+
+            if( smaps == NULL )
+            {
+                return 0;
+            }
+
+            char line[ 256 ];
+            bool inMapping = false;
+
+            while( fgets( line, sizeof( line ), smaps ) )
+            {
+                unsigned long long start, end, kilobytes;
+
+                if( sscanf( line, "%llx-%llx ", &start, &end ) == 2 )
+                {
+                    // a mapping's lines follow its address range. the kernel
+                    // can split the heap into several mappings, ie when
+                    // pages are protected or advised differently
+                    inMapping = start < ( size_t )mapping.base + mapping.size && end > ( size_t )mapping.base;
+                }
+                else if( inMapping && sscanf( line, "AnonHugePages: %llu kB", &kilobytes ) == 1 )
+                {
+                    hugeBytes += kilobytes * 1024;
+                }
+            }
+
+            fclose( smaps );
+#endif
+
+            return ( u32 )( hugeBytes / HUGE_PAGE_SIZE );
+        }
+
+
+        /*====================================================================
+
+            TrimPagePolicy::TrimPagePolicy
+
+        ====================================================================*/
+        TrimPagePolicy::TrimPagePolicy( )
+            : m_base( NULL )
+            , m_pageSize( 4096 )
+            , m_numPages( 0 )
+            , m_released( NULL )
+            , m_releasedPages( 0 )
+            , m_minTrimBytes( DEFAULT_MIN_TRIM_BYTES )
+            , m_lazy( false )
+        {
+#if defined( BB_HAS_MADVISE )
+            m_pageSize = ( u32 )sysconf( _SC_PAGESIZE );
+#endif
+        }
+
+
+        /*====================================================================
+
+            TrimPagePolicy::~TrimPagePolicy
+
+        ====================================================================*/
+        TrimPagePolicy::~TrimPagePolicy( )
+        {
+            free( m_released );
+        }
+
+
+        /*====================================================================
+
+            TrimPagePolicy::OnInit( void* heap, u32 heapSize )
+            - every page starts out as given back, since a new heap hasn't
+              been touched and advising it would only cost a system call
+
+        ====================================================================*/
+        void TrimPagePolicy::OnInit( void* heap, u32 heapSize )
+        {
+            size_t mask = ( size_t )m_pageSize - 1;
+            size_t first = ( size_t )heap & ~mask;
+            size_t last = ( ( size_t )heap + heapSize + mask ) & ~mask;
+
+            m_base = ( byte* )first;
+            m_numPages = ( u32 )( ( last - first ) / m_pageSize );
+
+            u32 numWords = ( m_numPages + 63 ) >> 6;
+
+            free( m_released );
+            m_released = ( u64* )malloc( numWords * sizeof( u64 ) );
+
+            if( m_released == NULL )
+            {
+                m_numPages = 0;
+                m_releasedPages = 0;
+                return;
+            }
+
+            memset( m_released, 0xFF, numWords * sizeof( u64 ) );
+            m_releasedPages = m_numPages;
+        }
+
+
+        /*====================================================================
+
+            TrimPagePolicy::Release( void* start, u32 size, u32 minRunBytes )
+            - gives back every run of resident whole pages inside the range
+              that is at least minRunBytes long. pages already given back are
+              skipped a word at a time
+            - @return: number of bytes given back
+
+        ====================================================================*/
+        u32 TrimPagePolicy::Release( void* start, u32 size, u32 minRunBytes )
+        {
+#if defined( BB_HAS_MADVISE )
+            if( m_released == NULL )
+            {
+                return 0;
+            }
+
+            size_t offset = ( size_t )( ( byte* )start - m_base );
+            u32 page = ( u32 )( ( offset + m_pageSize - 1 ) / m_pageSize );
+            u32 endPage = ( u32 )( ( offset + size ) / m_pageSize );
+            u32 released = 0;
+
+            while( page < endPage )
+            {
+                if( ( page & 63 ) == 0 && page + 64 <= endPage && m_released[ page >> 6 ] == ~0ull )
+                {
+                    page += 64;
+                    continue;
+                }
+
+                if( IsReleased( page ) )
+                {
+                    ++page;
+                    continue;
+                }
+
+                u32 runEnd = page + 1;
+
+                while( runEnd < endPage && !IsReleased( runEnd ) )
+                {
+                    ++runEnd;
+                }
+
+                u32 runBytes = ( runEnd - page ) * m_pageSize;
+
+                if( runBytes >= minRunBytes )
+                {
+    #if defined( MADV_FREE )
+                    int advice = m_lazy ? MADV_FREE : MADV_DONTNEED;
+    #else
+                    int advice = MADV_DONTNEED;
+    #endif
+
+                    if( madvise( m_base + ( size_t )page * m_pageSize, runBytes, advice ) == 0 )
+                    {
+                        for( u32 i = page; i < runEnd; ++i )
+                        {
+                            m_released[ i >> 6 ] |= 1ull << ( i & 63 );
+                        }
+
+                        m_releasedPages += runEnd - page;
+                        released += runBytes;
+                    }
+                }
+
+                page = runEnd;
+            }
+
+            return released;
+#else
+            ( void )start; ( void )size; ( void )minRunBytes;
+            return 0;
+#endif
+        }
+
+
+        /*====================================================================
+
+            TrimPagePolicy::MarkResident( void* start, u32 size )
+            - clears the bit of every page the range touches, since writing
+              to any part of a page brings the whole page back
+
+        ====================================================================*/
+        void TrimPagePolicy::MarkResident( void* start, u32 size )
+        {
+            size_t offset = ( size_t )( ( byte* )start - m_base );
+            u32 page = ( u32 )( offset / m_pageSize );
+            u32 endPage = ( u32 )( ( offset + size + m_pageSize - 1 ) / m_pageSize );
+
+            for( ; page < endPage && page < m_numPages; ++page )
+            {
+                u64 bit = 1ull << ( page & 63 );
+
+                if( m_released[ page >> 6 ] & bit )
+                {
+                    m_released[ page >> 6 ] &= ~bit;
+                    --m_releasedPages;
+                }
+            }
+        }
+    }
+}
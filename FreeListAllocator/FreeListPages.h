@@ -0,0 +1,128 @@
+#ifndef _BB_FREELIST_PAGES_H_ // [ _BB_FREELIST_PAGES_H_
+#define _BB_FREELIST_PAGES_H_
+
+#include "engine/memory/FreeListPolicies.h"
+
+namespace bbengine
+{
+    namespace mem
+    {
+        // options for how a heap's memory is obtained
+        enum heap_flags_e
+        {
+            HEAP_HUGE_PAGES             = 0x01,     // back the heap with 2 MiB pages where possible
+            HEAP_RESERVE                = 0x02,     // reserve the heap's address range, committing it as needed
+        };
+
+        // memory mapped for a heap by HeapPages_Map
+        struct heap_mapping_s
+        {
+            void*   base;           // NULL if nothing was mapped
+            u64     size;           // whole pages
+            u64     committed;      // bytes from base that can be used, size unless reserved
+            u32     granularity;    // bytes committed at a time
+            bool    explicitHuge;   // MAP_HUGETLB, so every page is a huge page
+        };
+
+        static const u64 HUGE_PAGE_SIZE = 2u << 20;
+        static const u32 MIN_COMMIT_SIZE = 256 * 1024;
+
+        // maps at least size bytes for a heap as flags asks. HEAP_HUGE_PAGES
+        // first tries a MAP_HUGETLB mapping out of the reserved huge page
+        // pool, then a 2 MiB aligned anonymous mapping marked MADV_HUGEPAGE
+        // for transparent huge pages. HEAP_RESERVE maps the range with no
+        // access and only commits the first MIN_COMMIT_SIZE bytes. huge
+        // pages are never explicit when reserving, since those are taken
+        // from the pool up front. huge pages are Linux only, elsewhere
+        // HEAP_HUGE_PAGES is ignored while HEAP_RESERVE works on any POSIX
+        // target. @return: false if the flags can't be met at all, in
+        // which case the heap should come from malloc
+        bool HeapPages_Map( u32 size, u32 flags, heap_mapping_s& mapping );
+        void HeapPages_Unmap( heap_mapping_s& mapping );
+        // commits at least size more bytes of a reserved mapping, in whole
+        // MIN_COMMIT_SIZE steps, up to the end of the mapping. @return:
+        // false if there is no room left or the OS refused
+        bool HeapPages_Commit( heap_mapping_s& mapping, u32 size );
+        // huge pages actually backing the mapping right now. transparent huge
+        // pages are only put in when the memory is first touched, and can be
+        // split up again by the kernel, so this changes over time
+        u32  HeapPages_CountHuge( const heap_mapping_s& mapping );
+
+
+        // PagePolicy that gives the whole pages inside free blocks back to
+        // the OS with madvise, so a heap's resident size comes back down
+        // after a peak instead of staying there. a bitmap with a bit per
+        // page remembers which pages have been given back, so the same
+        // range is never advised twice. a page is taken as resident again
+        // as soon as any part of it is allocated.
+        //
+        // Free only gives back runs of at least the minimum trim size, so
+        // blocks allocated and freed at the edge of a large free block don't
+        // cost a system call and a page fault each time. Trim gives back
+        // every whole page.
+        //
+        // free space reads back as zeros once given back, so this can't be
+        // used with a DebugPolicy that checks free space. does nothing on
+        // targets without madvise
+        class TrimPagePolicy
+        {
+        public:
+            static const bool RELEASES_FREE_SPACE = true;
+            static const u32 DEFAULT_MIN_TRIM_BYTES = 64 * 1024;
+
+            TrimPagePolicy( );
+            ~TrimPagePolicy( );
+
+            void OnInit( void* heap, u32 heapSize );
+            void OnRelease( )                               {}
+
+            void OnFreeSpace( void* start, u32 size )
+            {
+                if( size >= m_minTrimBytes )
+                {
+                    Release( start, size, m_minTrimBytes );
+                }
+            }
+
+            void OnReuseFreeSpace( void* start, u32 size )
+            {
+                if( m_releasedPages )
+                {
+                    MarkResident( start, size );
+                }
+            }
+
+            u32  Trim( void* start, u32 size )              { return Release( start, size, 0 ); }
+
+            // smallest run of free pages Free gives back
+            void SetMinTrimBytes( u32 minTrimBytes )        { m_minTrimBytes = minTrimBytes; }
+            // lazy release uses MADV_FREE where it is supported. the OS only
+            // reclaims the pages when it needs them, which is cheaper but
+            // leaves them counted in the resident size until then
+            void SetLazyRelease( bool lazy )                { m_lazy = lazy; }
+
+            // pages that are given back, or were never touched since the heap
+            // was created
+            u32  GetReleasedBytes( ) const                  { return m_releasedPages * m_pageSize; }
+
+        private:
+            TrimPagePolicy( TrimPagePolicy& );
+
+            u32  Release( void* start, u32 size, u32 minRunBytes );
+            void MarkResident( void* start, u32 size );
+
+            bool IsReleased( u32 page ) const               { return ( m_released[ page >> 6 ] >> ( page & 63 ) ) & 1; }
+
+            byte*   m_base;             // heap rounded down to a page
+            u32     m_pageSize;
+            u32     m_numPages;
+            u64*    m_released;         // bit per page from m_base, set once given back
+            u32     m_releasedPages;
+            u32     m_minTrimBytes;
+            bool    m_lazy;
+        };
+    }
+}
+
+
+#endif // ] _BB_FREELIST_PAGES_H_
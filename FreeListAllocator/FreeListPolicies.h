@@ -0,0 +1,432 @@
+#ifndef _BB_FREELIST_POLICIES_H_ // [ _BB_FREELIST_POLICIES_H_
+#define _BB_FREELIST_POLICIES_H_
+
+#include "engine/system/System.h"
+#include "engine/memory/MemoryUtils.h"
+#include <mutex>
+#include <string.h>
+
+namespace bbengine
+{
+    namespace mem
+    {
+        /*====================================================================
+
+            Policies used to build a BasicFreeListAllocator. Every policy
+            call is made from a non-virtual, inlined function, so the empty
+            policies below compile away to nothing.
+
+        ====================================================================*/
+
+
+        // FitPolicy - decides which free block an allocation is made from.
+        // FindBlock returns the chosen block (or NULL) and the block before
+        // it in the free list (NULL when it is the head of the list), and
+        // adds the number of free blocks it looked at to blocksVisited.
+        // policies that remember free blocks between calls are told when
+        // coalescing absorbs a free block into the one before it, and when
+        // the heap is reset. the allocator only keeps a top chunk for
+        // policies that set USES_TOP_CHUNK
+        class FirstFitPolicy
+        {
+        public:
+            static const bool USES_TOP_CHUNK = false;
+
+            void OnBlockAbsorbed( const void* absorbed, void* into )    { ( void )absorbed; ( void )into; }
+            void OnReset( )                                             {}
+
+            template< class Heap >
+            typename Heap::block_s* FindBlock( Heap& heap, u32 sizeNeeded, typename Heap::block_s*& prevBlock, u32& blocksVisited )
+            {
+                typename Heap::block_s* block = heap.GetFirstFree();
+                prevBlock = NULL;
+
+                // take the first block in address order that is big enough
+                while( block )
+                {
+                    ++blocksVisited;
+
+                    if( sizeNeeded <= Heap::GetSize( block ) )
+                    {
+                        break;
+                    }
+
+                    prevBlock = block;
+                    block = heap.GetNext( block );
+                }
+
+                return block;
+            }
+        };
+
+
+        // FitPolicy that carries on searching from where the last allocation
+        // was made ( next fit ), wrapping around to the head of the free
+        // list. spreads allocations over the heap instead of rescanning the
+        // small fragments that build up at low addresses. the rover is the
+        // free block before the last block allocated from, which stays in
+        // the free list when that block is taken out
+        class NextFitPolicy
+        {
+        public:
+            static const bool USES_TOP_CHUNK = false;
+
+            NextFitPolicy( )
+                : m_rover( NULL )
+            {
+            }
+
+            void OnBlockAbsorbed( const void* absorbed, void* into )
+            {
+                if( m_rover == absorbed )
+                {
+                    m_rover = into;
+                }
+            }
+
+            void OnReset( )                                             { m_rover = NULL; }
+
+            // free block the next search starts after, NULL for the head
+            const void* GetRover( ) const                               { return m_rover; }
+
+            template< class Heap >
+            typename Heap::block_s* FindBlock( Heap& heap, u32 sizeNeeded, typename Heap::block_s*& prevBlock, u32& blocksVisited )
+            {
+                typedef typename Heap::block_s block_s;
+
+                block_s* rover = ( block_s* )m_rover;
+                block_s* prev = rover;
+                block_s* block = rover ? heap.GetNext( rover ) : heap.GetFirstFree();
+
+                // from the rover to the end of the list
+                while( block )
+                {
+                    ++blocksVisited;
+
+                    if( sizeNeeded <= Heap::GetSize( block ) )
+                    {
+                        return Found( block, prev, prevBlock );
+                    }
+
+                    prev = block;
+                    block = heap.GetNext( block );
+                }
+
+                // from the head of the list up to and including the rover.
+                // the free list is address ordered
+                prev = NULL;
+                block = rover ? heap.GetFirstFree() : NULL;
+
+                while( block && block <= rover )
+                {
+                    ++blocksVisited;
+
+                    if( sizeNeeded <= Heap::GetSize( block ) )
+                    {
+                        return Found( block, prev, prevBlock );
+                    }
+
+                    prev = block;
+                    block = heap.GetNext( block );
+                }
+
+                prevBlock = NULL;
+                return NULL;
+            }
+
+        private:
+            template< class Block >
+            Block* Found( Block* block, Block* prev, Block*& prevBlock )
+            {
+                m_rover = prev;
+                prevBlock = prev;
+                return block;
+            }
+
+            void*   m_rover;    // free block to start searching after, NULL for the head
+        };
+
+
+        // FitPolicy that takes the smallest free block that is big enough
+        // ( best fit ), stopping early on an exact fit. looks at the whole
+        // free list for most allocations, but leaves the large blocks
+        // whole for as long as possible
+        class BestFitPolicy
+        {
+        public:
+            static const bool USES_TOP_CHUNK = false;
+
+            void OnBlockAbsorbed( const void* absorbed, void* into )    { ( void )absorbed; ( void )into; }
+            void OnReset( )                                             {}
+
+            template< class Heap >
+            typename Heap::block_s* FindBlock( Heap& heap, u32 sizeNeeded, typename Heap::block_s*& prevBlock, u32& blocksVisited )
+            {
+                typedef typename Heap::block_s block_s;
+
+                block_s* best = NULL;
+                block_s* prev = NULL;
+                prevBlock = NULL;
+
+                for( block_s* block = heap.GetFirstFree(); block; block = heap.GetNext( block ) )
+                {
+                    ++blocksVisited;
+
+                    u32 size = Heap::GetSize( block );
+
+                    if( sizeNeeded <= size && ( best == NULL || size < Heap::GetSize( best ) ) )
+                    {
+                        best = block;
+                        prevBlock = prev;
+
+                        if( size == sizeNeeded )
+                        {
+                            break;
+                        }
+                    }
+
+                    prev = block;
+                }
+
+                return best;
+            }
+        };
+
+
+        // FitPolicy that looks at no more than MAX_PROBES blocks from the
+        // head of the free list before bumping the top chunk, which starts
+        // out as the whole heap. allocations are carved off the end of the
+        // top chunk and blocks freed back next to it coalesce into it, so a
+        // heap that is mostly growing and shrinking at the top allocates in
+        // constant time however many small holes are left below it. the
+        // rest of the list is only searched when the top chunk is too small
+        template< u32 MAX_PROBES >
+        class TopChunkFitPolicy
+        {
+        public:
+            static const bool USES_TOP_CHUNK = true;
+
+            void OnBlockAbsorbed( const void* absorbed, void* into )    { ( void )absorbed; ( void )into; }
+            void OnReset( )                                             {}
+
+            template< class Heap >
+            typename Heap::block_s* FindBlock( Heap& heap, u32 sizeNeeded, typename Heap::block_s*& prevBlock, u32& blocksVisited )
+            {
+                typedef typename Heap::block_s block_s;
+
+                block_s* block = heap.GetFirstFree();
+                prevBlock = NULL;
+
+                for( u32 probes = 0; block && probes < MAX_PROBES; ++probes )
+                {
+                    ++blocksVisited;
+
+                    if( sizeNeeded <= Heap::GetSize( block ) )
+                    {
+                        return block;
+                    }
+
+                    prevBlock = block;
+                    block = heap.GetNext( block );
+                }
+
+                if( block == NULL )
+                {
+                    return NULL;
+                }
+
+                // the top chunk is bumped in place, so it doesn't need the
+                // block in front of it
+                block_s* top = heap.GetTopChunk();
+                ++blocksVisited;
+
+                if( sizeNeeded <= Heap::GetSize( top ) )
+                {
+                    prevBlock = NULL;
+                    return top;
+                }
+
+                // carry on with first fit through the rest of the list
+                while( block )
+                {
+                    ++blocksVisited;
+
+                    if( sizeNeeded <= Heap::GetSize( block ) )
+                    {
+                        return block;
+                    }
+
+                    prevBlock = block;
+                    block = heap.GetNext( block );
+                }
+
+                prevBlock = NULL;
+                return NULL;
+            }
+        };
+
+
+        // LockPolicy - guards the free list when an allocator is shared
+        // between threads
+        class NullLockPolicy
+        {
+        public:
+            void Lock( )    {}
+            void Unlock( )  {}
+        };
+
+        class MutexLockPolicy
+        {
+        public:
+            void Lock( )    { m_mutex.lock(); }
+            void Unlock( )  { m_mutex.unlock(); }
+
+        private:
+            std::mutex  m_mutex;
+        };
+
+        // holds a LockPolicy for the lifetime of a scope
+        template< class LockPolicy >
+        class ScopedPolicyLock
+        {
+        public:
+            explicit ScopedPolicyLock( LockPolicy& lock ) : m_lock( lock )  { m_lock.Lock(); }
+            ~ScopedPolicyLock( )                                            { m_lock.Unlock(); }
+
+        private:
+            ScopedPolicyLock( ScopedPolicyLock& );
+
+            LockPolicy& m_lock;
+        };
+
+
+        // heap counters reported by a StatsPolicy. sizes are usable bytes
+        // and do not include block headers
+        struct heap_stats_s
+        {
+            u32     bytesInUse;         // bytes in blocks that are in use
+            u32     peakBytesInUse;     // highest bytesInUse since construction
+            u32     bytesFree;          // bytes in free blocks
+            u32     freeBlockCount;     // number of blocks in the free list
+            u32     largestFreeBlock;   // usable size of the largest free block. allocations also need
+                                        // room for a header and alignment, so the largest that can
+                                        // succeed is this less the aligned header size, rounded down
+            u32     numAllocations;     // blocks currently in use
+            u32     totalAllocations;   // blocks handed out since construction
+            float   fragmentation;      // 1 - largestFreeBlock / bytesFree
+        };
+
+        // StatsPolicy - told about every block handed out and returned, and
+        // every change to the free list. blockSize is the usable size of the
+        // block, not the requested size. tag is the block's memtag_t
+        class NullStatsPolicy
+        {
+        public:
+            void OnAllocate( void* ptr, u32 blockSize, u32 tag )    { ( void )ptr; ( void )blockSize; ( void )tag; }
+            void OnFree( void* ptr, u32 blockSize, u32 tag )        { ( void )ptr; ( void )blockSize; ( void )tag; }
+            void OnReset( )                             {}
+
+            void OnFreeBlockAdded( u32 blockSize )      { ( void )blockSize; }
+            void OnFreeBlockRemoved( u32 blockSize )    { ( void )blockSize; }
+            // two adjacent free blocks were coalesced into one of joinedSize
+            void OnFreeBlocksJoined( u32 firstSize, u32 secondSize, u32 joinedSize ) { ( void )firstSize; ( void )secondSize; ( void )joinedSize; }
+
+            // per call instrumentation, made once AllocateAligned and Free have
+            // finished with the free list. startTime is ReadCycleCounter() on
+            // entry when TIMED_OPERATIONS is set, and 0 otherwise. tag is the
+            // tag the block was allocated with, the same one OnAllocate and
+            // OnFree are given
+            static const bool TIMED_OPERATIONS = false;
+
+            void OnAllocateDone( u64 startTime, u32 numBytes, align_t alignment, void* ptr, u32 tag, u32 blocksVisited )
+            {
+                ( void )startTime; ( void )numBytes; ( void )alignment; ( void )ptr; ( void )tag; ( void )blocksVisited;
+            }
+            void OnFreeDone( u64 startTime, void* ptr, u32 tag, u32 blocksVisited )
+            {
+                ( void )startTime; ( void )ptr; ( void )tag; ( void )blocksVisited;
+            }
+
+            // when stale, the allocator walks the free list and passes the
+            // largest block size, how many blocks have it and the next
+            // largest size
+            bool IsLargestFreeBlockStale( ) const       { return false; }
+            void SetLargestFreeBlock( u32 blockSize, u32 numBlocks, u32 nextSize ) { ( void )blockSize; ( void )numBlocks; ( void )nextSize; }
+            void GetStats( heap_stats_s& stats ) const  { memset( &stats, 0, sizeof( stats ) ); }
+        };
+
+
+        // DebugPolicy - hooks for validating pointers and block contents.
+        // IsValidBlock is asked about every pointer passed to Free and
+        // GetBlockSize before its header is read, and IsIntactBlock checks
+        // the block once its size is known. pointers either rejects are
+        // reported to OnInvalidPointer and otherwise ignored.
+        //
+        // policies that set USES_HEADER_CANARY get 16 bits of the in use
+        // block's header for free: GetHeaderCanary is stored above the tag
+        // when the block is allocated, and handed back to IsIntactBlock.
+        // 0 means no canary
+        //
+        // the free space hooks cover the memory of free blocks, which the
+        // allocator never reads or writes except for block headers:
+        // OnFreeSpace is told about memory that has become free space, and
+        // OnReuseFreeSpace is told before any of it is written to again.
+        // OnHeaderAbsorbed is told when coalescing turns a block header into
+        // free space. CHECKS_FREE_SPACE is set by policies that expect free
+        // space to keep what they wrote to it
+        //
+        // OnInit is given the whole address range the heap can grow into,
+        // and OnCommit each part of it that becomes usable memory, starting
+        // with the heap's initial size. a heap loaded from an image gets
+        // OnRestore instead of OnCommit, since its memory already holds
+        // blocks, and then OnRestoreBlock for every block in use
+        class NullDebugPolicy
+        {
+        public:
+            static const bool USES_HEADER_CANARY = false;
+            static const bool CHECKS_FREE_SPACE = false;
+
+            void OnInit( void* heap, u32 heapSize )     { ( void )heap; ( void )heapSize; }
+            void OnCommit( void* start, u32 size )      { ( void )start; ( void )size; }
+            void OnRestore( void* start, u32 size )     { ( void )start; ( void )size; }
+            void OnRestoreBlock( void* ptr, u32 blockSize ) { ( void )ptr; ( void )blockSize; }
+            void OnRelease( )                           {}
+            void OnAllocate( void* ptr, u32 blockSize ) { ( void )ptr; ( void )blockSize; }
+            void OnFree( void* ptr, u32 blockSize )     { ( void )ptr; ( void )blockSize; }
+            void OnReset( )                             {}
+
+            void OnFreeSpace( void* start, u32 size )       { ( void )start; ( void )size; }
+            void OnReuseFreeSpace( void* start, u32 size )  { ( void )start; ( void )size; }
+            void OnHeaderAbsorbed( void* header, u32 size ) { ( void )header; ( void )size; }
+
+            bool IsValidBlock( const void* ptr ) const                  { ( void )ptr; return true; }
+            u32  GetHeaderCanary( const void* ptr, u32 blockSize ) const            { ( void )ptr; ( void )blockSize; return 0; }
+            bool IsIntactBlock( const void* ptr, u32 blockSize, u32 canary ) const  { ( void )ptr; ( void )blockSize; ( void )canary; return true; }
+            void OnInvalidPointer( const void* ptr )                    { ( void )ptr; }
+        };
+
+
+        // PagePolicy - looks after the pages under the heap. gets the same
+        // free space hooks as DebugPolicy, after it. Trim is asked to give
+        // back the pages of a free block right away. RELEASES_FREE_SPACE is
+        // set by policies that hand free pages back to the OS, after which
+        // free space can read back as zeros
+        class NullPagePolicy
+        {
+        public:
+            static const bool RELEASES_FREE_SPACE = false;
+
+            void OnInit( void* heap, u32 heapSize )         { ( void )heap; ( void )heapSize; }
+            void OnRelease( )                               {}
+
+            void OnFreeSpace( void* start, u32 size )       { ( void )start; ( void )size; }
+            void OnReuseFreeSpace( void* start, u32 size )  { ( void )start; ( void )size; }
+
+            // @return: number of bytes given back
+            u32  Trim( void* start, u32 size )              { ( void )start; ( void )size; return 0; }
+        };
+    }
+}
+
+
+#endif // ] _BB_FREELIST_POLICIES_H_
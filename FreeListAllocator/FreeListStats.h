@@ -0,0 +1,355 @@
+#ifndef _BB_FREELIST_STATS_H_ // [ _BB_FREELIST_STATS_H_
+#define _BB_FREELIST_STATS_H_
+
+#include "engine/system/Assert.h"
+#include "engine/memory/FreeListPolicies.h"
+#include "engine/memory/LogHistogram.h"
+#include "engine/memory/MemoryTags.h"
+
+namespace bbengine
+{
+    namespace mem
+    {
+        // StatsPolicy that keeps heap_stats_s up to date as the heap changes.
+        // every hook is a handful of adds and compares. the largest free
+        // block is the exception: only the largest size and a bound on the
+        // next are kept, so it goes stale when the last block of that size
+        // is allocated from and the allocator has to walk the free list to
+        // set it again
+        class HeapStatsPolicy : public NullStatsPolicy
+        {
+        public:
+            HeapStatsPolicy( )
+            {
+                memset( &m_stats, 0, sizeof( m_stats ) );
+                m_largestCount = 0;
+                m_belowLargest = 0;
+                m_largestStale = false;
+            }
+
+            void OnAllocate( void* ptr, u32 blockSize, u32 tag )
+            {
+                ( void )ptr; ( void )tag;
+
+                m_stats.bytesInUse += blockSize;
+                ++m_stats.numAllocations;
+                ++m_stats.totalAllocations;
+
+                if( m_stats.bytesInUse > m_stats.peakBytesInUse )
+                {
+                    m_stats.peakBytesInUse = m_stats.bytesInUse;
+                }
+            }
+
+            void OnFree( void* ptr, u32 blockSize, u32 tag )
+            {
+                ( void )ptr; ( void )tag;
+
+                m_stats.bytesInUse -= blockSize;
+                --m_stats.numAllocations;
+            }
+
+            void OnReset( )
+            {
+                // peak and total survive a reset, everything else is rebuilt
+                // as the new free list is set up
+                m_stats.bytesInUse = 0;
+                m_stats.bytesFree = 0;
+                m_stats.freeBlockCount = 0;
+                m_stats.largestFreeBlock = 0;
+                m_stats.numAllocations = 0;
+                m_largestCount = 0;
+                m_belowLargest = 0;
+                m_largestStale = false;
+            }
+
+            void OnFreeBlockAdded( u32 blockSize )
+            {
+                m_stats.bytesFree += blockSize;
+                ++m_stats.freeBlockCount;
+
+                if( m_largestStale )
+                {
+                    // largestFreeBlock is an upper bound, so a bigger block is
+                    // known to be the largest
+                    if( blockSize > m_stats.largestFreeBlock )
+                    {
+                        m_belowLargest = m_stats.largestFreeBlock;
+                        m_stats.largestFreeBlock = blockSize;
+                        m_largestCount = 1;
+                        m_largestStale = false;
+                    }
+                }
+                else if( blockSize > m_stats.largestFreeBlock )
+                {
+                    m_belowLargest = m_stats.largestFreeBlock;
+                    m_stats.largestFreeBlock = blockSize;
+                    m_largestCount = 1;
+                }
+                else if( blockSize == m_stats.largestFreeBlock )
+                {
+                    ++m_largestCount;
+                }
+                else if( blockSize > m_belowLargest )
+                {
+                    m_belowLargest = blockSize;
+                }
+            }
+
+            void OnFreeBlockRemoved( u32 blockSize )
+            {
+                m_stats.bytesFree -= blockSize;
+                --m_stats.freeBlockCount;
+
+                if( !m_largestStale && blockSize == m_stats.largestFreeBlock && --m_largestCount == 0 )
+                {
+                    // the next largest block is at most m_belowLargest. when
+                    // a block is split, ie the top chunk is bumped, the part
+                    // added back is usually bigger than that and the largest
+                    // is known again without walking the free list
+                    m_stats.largestFreeBlock = m_belowLargest;
+                    m_largestStale = true;
+                }
+            }
+
+            void OnFreeBlocksJoined( u32 firstSize, u32 secondSize, u32 joinedSize )
+            {
+                OnFreeBlockRemoved( firstSize );
+                OnFreeBlockRemoved( secondSize );
+                OnFreeBlockAdded( joinedSize );
+            }
+
+            bool IsLargestFreeBlockStale( ) const
+            {
+                return m_largestStale;
+            }
+
+            void SetLargestFreeBlock( u32 blockSize, u32 numBlocks, u32 nextSize )
+            {
+                m_stats.largestFreeBlock = blockSize;
+                m_largestCount = numBlocks;
+                m_belowLargest = nextSize;
+                m_largestStale = false;
+            }
+
+            void GetStats( heap_stats_s& stats ) const
+            {
+                stats = m_stats;
+                stats.fragmentation = m_stats.bytesFree ? 1.0f - ( float )m_stats.largestFreeBlock / ( float )m_stats.bytesFree : 0.0f;
+            }
+
+        private:
+            heap_stats_s    m_stats;
+            u32             m_largestCount;     // free blocks of largestFreeBlock bytes
+            u32             m_belowLargest;     // no free block smaller than largestFreeBlock is bigger than this
+            bool            m_largestStale;     // every block of largestFreeBlock bytes was allocated from, so it
+                                                // is only an upper bound
+        };
+
+
+        // StatsPolicy that records how long each AllocateAligned and Free
+        // call took, in cycles, and how many free blocks it had to look at.
+        // AllocateAligned counts blocks tried by the FitPolicy and Free
+        // counts blocks passed while finding its place in the free list
+        class LatencyStatsPolicy : public NullStatsPolicy
+        {
+        public:
+            struct snapshot_s
+            {
+                LogHistogram::snapshot_s    allocateCycles;
+                LogHistogram::snapshot_s    allocateBlocksVisited;
+                LogHistogram::snapshot_s    freeCycles;
+                LogHistogram::snapshot_s    freeBlocksVisited;
+            };
+
+            static const bool TIMED_OPERATIONS = true;
+
+            void OnAllocateDone( u64 startTime, u32 numBytes, align_t alignment, void* ptr, u32 tag, u32 blocksVisited )
+            {
+                ( void )numBytes; ( void )alignment; ( void )ptr; ( void )tag;
+
+                m_allocateCycles.Record( ReadCycleCounter() - startTime );
+                m_allocateBlocksVisited.Record( blocksVisited );
+            }
+
+            void OnFreeDone( u64 startTime, void* ptr, u32 tag, u32 blocksVisited )
+            {
+                ( void )ptr; ( void )tag;
+
+                m_freeCycles.Record( ReadCycleCounter() - startTime );
+                m_freeBlocksVisited.Record( blocksVisited );
+            }
+
+            // safe to call from any thread. pass reset to get per interval
+            // histograms ( ie once a frame or once a second )
+            void Snapshot( snapshot_s& snapshot, bool reset )
+            {
+                m_allocateCycles.Snapshot( snapshot.allocateCycles, reset );
+                m_allocateBlocksVisited.Snapshot( snapshot.allocateBlocksVisited, reset );
+                m_freeCycles.Snapshot( snapshot.freeCycles, reset );
+                m_freeBlocksVisited.Snapshot( snapshot.freeBlocksVisited, reset );
+            }
+
+            static void Print( FILE* file, const snapshot_s& snapshot )
+            {
+                LogHistogram::Print( file, "Allocate cycles", snapshot.allocateCycles );
+                LogHistogram::Print( file, "Allocate blocks visited", snapshot.allocateBlocksVisited );
+                LogHistogram::Print( file, "Free cycles", snapshot.freeCycles );
+                LogHistogram::Print( file, "Free blocks visited", snapshot.freeBlocksVisited );
+            }
+
+        private:
+            LogHistogram    m_allocateCycles;
+            LogHistogram    m_allocateBlocksVisited;
+            LogHistogram    m_freeCycles;
+            LogHistogram    m_freeBlocksVisited;
+        };
+
+
+        // per tag usage, as kept by TagStatsPolicy
+        struct mem_tag_stats_s
+        {
+            u32     bytesInUse;
+            u32     peakBytesInUse;
+            u32     numAllocations;
+            u32     budget;             // 0 for no budget
+        };
+
+        // called when a tag's bytesInUse goes over its budget ( overBudget is
+        // true ) or comes back down to it ( overBudget is false ). called with
+        // the allocator locked, so it must not call back into the allocator
+        typedef void ( *mem_tag_budget_callback_t )( memtag_t tag, u32 bytesInUse, u32 budget, bool overBudget, void* userData );
+
+        // StatsPolicy that keeps bytes in use per memory tag and checks them
+        // against budgets. each hook is an array index, an add and a compare,
+        // so this is cheap enough to leave on in shipping builds
+        class TagStatsPolicy : public NullStatsPolicy
+        {
+        public:
+            TagStatsPolicy( )
+            {
+                memset( m_tags, 0, sizeof( m_tags ) );
+                m_callback = NULL;
+                m_userData = NULL;
+            }
+
+            void OnAllocate( void* ptr, u32 blockSize, u32 tag )
+            {
+                ( void )ptr;
+
+                mem_tag_stats_s& stats = m_tags[ tag < MAX_MEM_TAGS ? tag : MEM_TAG_NONE ];
+                u32 before = stats.bytesInUse;
+
+                stats.bytesInUse += blockSize;
+                ++stats.numAllocations;
+
+                if( stats.bytesInUse > stats.peakBytesInUse )
+                {
+                    stats.peakBytesInUse = stats.bytesInUse;
+                }
+
+                if( stats.budget && before <= stats.budget && stats.bytesInUse > stats.budget && m_callback )
+                {
+                    m_callback( ( memtag_t )tag, stats.bytesInUse, stats.budget, true, m_userData );
+                }
+            }
+
+            void OnFree( void* ptr, u32 blockSize, u32 tag )
+            {
+                ( void )ptr;
+
+                mem_tag_stats_s& stats = m_tags[ tag < MAX_MEM_TAGS ? tag : MEM_TAG_NONE ];
+                u32 before = stats.bytesInUse;
+
+                stats.bytesInUse -= blockSize;
+                --stats.numAllocations;
+
+                if( stats.budget && before > stats.budget && stats.bytesInUse <= stats.budget && m_callback )
+                {
+                    m_callback( ( memtag_t )tag, stats.bytesInUse, stats.budget, false, m_userData );
+                }
+            }
+
+            void OnReset( )
+            {
+                // budgets and peaks survive a reset
+                for( u32 i = 0; i < MAX_MEM_TAGS; ++i )
+                {
+                    m_tags[ i ].bytesInUse = 0;
+                    m_tags[ i ].numAllocations = 0;
+                }
+            }
+
+            // budget of 0 removes the budget for tag
+            void SetBudget( memtag_t tag, u32 budget )
+            {
+                DEBUG_ASSERT( tag < MAX_MEM_TAGS && "Memory tag out of range" );
+                m_tags[ tag ].budget = budget;
+            }
+
+            void SetBudgetCallback( mem_tag_budget_callback_t callback, void* userData )
+            {
+                m_callback = callback;
+                m_userData = userData;
+            }
+
+            const mem_tag_stats_s& GetTagStats( memtag_t tag ) const
+            {
+                DEBUG_ASSERT( tag < MAX_MEM_TAGS && "Memory tag out of range" );
+                return m_tags[ tag ];
+            }
+
+        private:
+            mem_tag_stats_s             m_tags[ MAX_MEM_TAGS ];     // tags out of range are counted as MEM_TAG_NONE
+            mem_tag_budget_callback_t   m_callback;
+            void*                       m_userData;
+        };
+
+
+        // runs two StatsPolicies side by side. every hook goes to both, and
+        // the heap_stats_s queries are answered by First
+        template< class First, class Second >
+        class StatsPolicyPair
+        {
+        public:
+            static const bool TIMED_OPERATIONS = First::TIMED_OPERATIONS || Second::TIMED_OPERATIONS;
+
+            void OnAllocate( void* ptr, u32 blockSize, u32 tag )    { m_first.OnAllocate( ptr, blockSize, tag ); m_second.OnAllocate( ptr, blockSize, tag ); }
+            void OnFree( void* ptr, u32 blockSize, u32 tag )        { m_first.OnFree( ptr, blockSize, tag ); m_second.OnFree( ptr, blockSize, tag ); }
+            void OnReset( )                                 { m_first.OnReset(); m_second.OnReset(); }
+
+            void OnFreeBlockAdded( u32 blockSize )          { m_first.OnFreeBlockAdded( blockSize ); m_second.OnFreeBlockAdded( blockSize ); }
+            void OnFreeBlockRemoved( u32 blockSize )        { m_first.OnFreeBlockRemoved( blockSize ); m_second.OnFreeBlockRemoved( blockSize ); }
+            void OnFreeBlocksJoined( u32 firstSize, u32 secondSize, u32 joinedSize )
+            {
+                m_first.OnFreeBlocksJoined( firstSize, secondSize, joinedSize );
+                m_second.OnFreeBlocksJoined( firstSize, secondSize, joinedSize );
+            }
+
+            void OnAllocateDone( u64 startTime, u32 numBytes, align_t alignment, void* ptr, u32 tag, u32 blocksVisited )
+            {
+                m_first.OnAllocateDone( startTime, numBytes, alignment, ptr, tag, blocksVisited );
+                m_second.OnAllocateDone( startTime, numBytes, alignment, ptr, tag, blocksVisited );
+            }
+            void OnFreeDone( u64 startTime, void* ptr, u32 tag, u32 blocksVisited )
+            {
+                m_first.OnFreeDone( startTime, ptr, tag, blocksVisited );
+                m_second.OnFreeDone( startTime, ptr, tag, blocksVisited );
+            }
+
+            bool IsLargestFreeBlockStale( ) const           { return m_first.IsLargestFreeBlockStale(); }
+            void SetLargestFreeBlock( u32 blockSize, u32 numBlocks, u32 nextSize )  { m_first.SetLargestFreeBlock( blockSize, numBlocks, nextSize ); }
+            void GetStats( heap_stats_s& stats ) const      { m_first.GetStats( stats ); }
+
+            First&  GetFirst( )                             { return m_first; }
+            Second& GetSecond( )                            { return m_second; }
+
+        private:
+            First   m_first;
+            Second  m_second;
+        };
+    }
+}
+
+
+#endif // ] _BB_FREELIST_STATS_H_
@@ -0,0 +1,171 @@
+#include "engine/memory/HeapImage.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#if defined( __unix__ ) || defined( __APPLE__ )
+    #include <sys/mman.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+    #define BB_HAS_MMAP 1
+#endif
+
+namespace bbengine
+{
+    namespace mem
+    {
+        /*====================================================================
+
+            HeapImage_Write
+            - the heap is padded out to dataOffset and its offset into
+              HEAP_IMAGE_ALIGNMENT, so the file can be mapped from dataOffset
+              with the heap at the same offset into a page as it was
+
+        ====================================================================*/
+        bool HeapImage_Write( const char* path, const heap_image_header_s& header, const u32* pointerOffsets, const void* heap )
+        {
+            FILE* file = fopen( path, "wb" );
+
+            if( file == NULL )
+            {
+                return false;
+            }
+
+            bool ok = fwrite( &header, sizeof( header ), 1, file ) == 1;
+
+            if( ok && header.numPointers )
+            {
+                ok = fwrite( pointerOffsets, sizeof( u32 ), header.numPointers, file ) == header.numPointers;
+            }
+
+            u32 written = sizeof( header ) + sizeof( u32 ) * header.numPointers;
+            u32 heapOffset = header.dataOffset + ( u32 )( header.savedBase & ( HEAP_IMAGE_ALIGNMENT - 1 ) );
+            static const byte zeros[ 4096 ] = { 0 };
+
+            while( ok && written < heapOffset )
+            {
+                u32 count = heapOffset - written < sizeof( zeros ) ? heapOffset - written : ( u32 )sizeof( zeros );
+                ok = fwrite( zeros, 1, count, file ) == count;
+                written += count;
+            }
+
+            if( ok )
+            {
+                ok = fwrite( heap, 1, header.heapSize, file ) == header.heapSize;
+            }
+
+            return fclose( file ) == 0 && ok;
+        }
+
+
+        /*====================================================================
+
+            HeapImage_Load
+            - reads the header and pointer offsets, maps the heap private
+              and read / write from dataOffset, then moves every listed
+              pointer that pointed into the saved heap by the distance
+              between the saved and new base. only the pages holding those
+              pointers are copied
+            - the heap is mapped at its saved address when that range is
+              free, in which case no pointers move and no pages are copied
+            - the pointer offsets are checked against the heap, so a
+              damaged file can't write outside the mapping
+
+        ====================================================================*/
+        bool HeapImage_Load( const char* path, u32 blockHeaderSize, heap_image_s& image )
+        {
+            image.mapping.base = NULL;
+            image.mapping.size = 0;
+            image.mapping.committed = 0;
+            image.mapping.granularity = 0;
+            image.mapping.explicitHuge = false;
+            image.heap = NULL;
+            image.flags = 0;
+            image.root = NULL;
+
+#if defined( BB_HAS_MMAP )
+            FILE* file = fopen( path, "rb" );
+
+            if( file == NULL )
+            {
+                return false;
+            }
+
+            heap_image_header_s header;
+            u32* pointerOffsets = NULL;
+
+            bool ok = fread( &header, sizeof( header ), 1, file ) == 1 &&
+                      header.magic == HEAP_IMAGE_MAGIC &&
+                      header.version == HEAP_IMAGE_VERSION &&
+                      header.blockHeaderSize == blockHeaderSize &&
+                      header.heapSize > blockHeaderSize &&
+                      header.dataOffset % HEAP_IMAGE_ALIGNMENT == 0 &&
+                      ( header.firstFree == HEAP_IMAGE_NO_OFFSET || header.firstFree < header.heapSize );
+
+            size_t heapOffset = ( size_t )( header.savedBase & ( HEAP_IMAGE_ALIGNMENT - 1 ) );
+
+            if( ok )
+            {
+                // touching a mapped page past the end of the file faults
+                ok = fseek( file, 0, SEEK_END ) == 0 && ( u64 )ftell( file ) >= ( u64 )header.dataOffset + heapOffset + header.heapSize;
+            }
+
+            if( ok && header.numPointers )
+            {
+                fseek( file, sizeof( header ), SEEK_SET );
+                pointerOffsets = ( u32* )malloc( sizeof( u32 ) * header.numPointers );
+                ok = pointerOffsets && fread( pointerOffsets, sizeof( u32 ), header.numPointers, file ) == header.numPointers;
+            }
+
+            byte* base = NULL;
+            size_t pageSize = ( size_t )sysconf( _SC_PAGESIZE );
+            size_t mapSize = ( heapOffset + header.heapSize + pageSize - 1 ) & ~( pageSize - 1 );
+
+            if( ok )
+            {
+                void* mapped = mmap( ( void* )( size_t )( header.savedBase - heapOffset ), mapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno( file ), ( off_t )header.dataOffset );
+                base = mapped != MAP_FAILED ? ( byte* )mapped : NULL;
+                ok = base != NULL;
+            }
+
+            fclose( file );
+
+            if( ok )
+            {
+                size_t savedBase = ( size_t )header.savedBase;
+                byte* heap = base + heapOffset;
+
+                for( u32 i = 0; i < header.numPointers && heap != ( byte* )savedBase; ++i )
+                {
+                    if( pointerOffsets[ i ] > header.heapSize - sizeof( void* ) )
+                    {
+                        continue;
+                    }
+
+                    size_t* location = ( size_t* )( heap + pointerOffsets[ i ] );
+
+                    if( *location >= savedBase && *location < savedBase + header.heapSize )
+                    {
+                        *location = *location - savedBase + ( size_t )heap;
+                    }
+                }
+
+                image.mapping.base = base;
+                image.mapping.size = mapSize;
+                image.mapping.committed = mapSize;
+                image.heap = heap;
+                image.heapSize = header.heapSize;
+                image.firstFree = header.firstFree;
+                image.flags = header.flags;
+                image.root = header.root < header.heapSize ? heap + header.root : NULL;
+            }
+
+            free( pointerOffsets );
+
+            return ok;
+#else
+            ( void )path; ( void )blockHeaderSize;
+            return false;
+#endif
+        }
+    }
+}
@@ -0,0 +1,96 @@
+#ifndef _BB_HEAP_IMAGE_H_ // [ _BB_HEAP_IMAGE_H_
+#define _BB_HEAP_IMAGE_H_
+
+#include "engine/memory/FreeListPages.h"
+
+namespace bbengine
+{
+    namespace mem
+    {
+        /*====================================================================
+
+            Heap images - a whole BasicFreeListAllocator heap written to a
+            file, so a level's allocations can be built once when cooking
+            and mapped back in when loading instead of being made again.
+
+            layout:
+                heap_image_header_s
+                u32 pointer offsets[ numPointers ]
+                padding up to dataOffset, a multiple of HEAP_IMAGE_ALIGNMENT
+                padding up to the heap's offset into HEAP_IMAGE_ALIGNMENT
+                the heap, heapSize bytes
+
+            the heap keeps its offset into a HEAP_IMAGE_ALIGNMENT sized
+            unit, so it can be mapped back at the address it was saved from
+            and so the alignment of its blocks doesn't change
+
+            only heaps with OffsetBlockHeader can be saved, since their free
+            list links are offsets and don't depend on where the heap is.
+            pointers inside user data are listed when saving and moved to
+            the new base when loading. every other byte is used as is
+
+            the layout does not depend on the DebugPolicy, so an image
+            cooked by a shipping build loads into a development one and
+            the other way round. header canaries live in the block's tag
+            word and are made from offsets, so they hold at any base.
+            HEAP_IMAGE_BLOCK_CANARIES says whether the blocks have them; a
+            heap that checks canaries accepts the blocks of an image
+            without them unchecked until they are freed, rather than
+            writing every header and copying every page on load
+
+        ====================================================================*/
+
+        static const u32 HEAP_IMAGE_MAGIC       = 0x49484242;   // "BBHI"
+        static const u32 HEAP_IMAGE_VERSION     = 2;
+        static const u32 HEAP_IMAGE_ALIGNMENT   = 64 * 1024;    // so the heap can be mapped on any page size
+        static const u32 HEAP_IMAGE_NO_OFFSET   = 0xFFFFFFFFu;
+
+        enum heap_image_flags_e
+        {
+            HEAP_IMAGE_BLOCK_CANARIES   = 0x0001,   // in use blocks carry a DebugPolicy header canary
+        };
+
+        struct heap_image_header_s
+        {
+            u32     magic;
+            u32     version;
+            u32     blockHeaderSize;    // ALIGNED_HEADER_SIZE of the allocator it came from
+            u32     heapSize;
+            u32     firstFree;          // offset of the first free block, HEAP_IMAGE_NO_OFFSET for none
+            u32     root;               // offset of the caller's root object, HEAP_IMAGE_NO_OFFSET for none
+            u32     numPointers;
+            u32     dataOffset;         // file offset of the mapping the heap is in
+            u32     flags;              // heap_image_flags_e
+            u32     reserved;
+            u64     savedBase;          // address of the heap when it was saved
+        };
+
+        // a heap mapped in by HeapImage_Load, ready to be handed to a
+        // BasicFreeListAllocator, which takes over the mapping
+        struct heap_image_s
+        {
+            heap_mapping_s  mapping;
+            void*           heap;       // inside the mapping
+            u32             heapSize;
+            u32             firstFree;  // offset, HEAP_IMAGE_NO_OFFSET for none
+            u32             flags;      // heap_image_flags_e
+            void*           root;       // at its new address
+        };
+
+        // writes header, the pointer offsets and heapSize bytes of heap
+        // @return: false if the file could not be written
+        bool HeapImage_Write( const char* path, const heap_image_header_s& header, const u32* pointerOffsets, const void* heap );
+
+        // maps the heap in an image copy on write, so pages are read from
+        // the file as they are first touched and the file is never
+        // changed. the heap goes back at the address it was saved from if
+        // that is free, otherwise the listed pointers are moved to the new
+        // base, which copies every page that holds one.
+        // @return: false if the file is missing, from a different version or
+        // block header size, or can't be mapped
+        bool HeapImage_Load( const char* path, u32 blockHeaderSize, heap_image_s& image );
+    }
+}
+
+
+#endif // ] _BB_HEAP_IMAGE_H_
@@ -0,0 +1,367 @@
+#include "engine/memory/HeapProfiler.h"
+#include "engine/memory/LogHistogram.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined( __linux__ ) || defined( __APPLE__ )
+    #include <execinfo.h>
+    #define BB_HAS_BACKTRACE 1
+#endif
+
+namespace bbengine
+{
+    namespace mem
+    {
+        // Sample's own frame. the allocator's frames above it depend on what
+        // was inlined, so they are left in for pprof to drop by name
+        static const int SKIPPED_FRAMES = 1;
+
+        static const u64 NEVER_SAMPLE = ~0ull;
+
+
+        /*====================================================================
+
+            HeapProfileStatsPolicy::HeapProfileStatsPolicy
+            - sampling is off until SetSampleInterval is called
+
+        ====================================================================*/
+        HeapProfileStatsPolicy::HeapProfileStatsPolicy( )
+            : m_bytesUntilSample( NEVER_SAMPLE )
+            , m_sampleInterval( 0 )
+            , m_random( ReadCycleCounter() ^ ( u64 )( size_t )this )
+            , m_samples( NULL )
+            , m_capacity( 0 )
+            , m_numSamples( 0 )
+        {
+            if( m_random == 0 )
+            {
+                m_random = 1;
+            }
+        }
+
+
+        /*====================================================================
+
+            HeapProfileStatsPolicy::~HeapProfileStatsPolicy
+
+        ====================================================================*/
+        HeapProfileStatsPolicy::~HeapProfileStatsPolicy( )
+        {
+            free( m_samples );
+        }
+
+
+        /*====================================================================
+
+            HeapProfileStatsPolicy::SetSampleInterval( u32 sampleInterval )
+            - sets the average number of bytes allocated between samples
+
+        ====================================================================*/
+        void HeapProfileStatsPolicy::SetSampleInterval( u32 sampleInterval )
+        {
+            m_sampleInterval = sampleInterval;
+            m_bytesUntilSample = NextSampleGap();
+        }
+
+
+        /*====================================================================
+
+            HeapProfileStatsPolicy::NextSampleGap
+            - @return: bytes to allocate before the next sample, drawn from an
+              exponential distribution with a mean of the sample interval
+
+        ====================================================================*/
+        u64 HeapProfileStatsPolicy::NextSampleGap( )
+        {
+            if( m_sampleInterval == 0 )
+            {
+                return NEVER_SAMPLE;
+            }
+
+            // xorshift64
+            m_random ^= m_random << 13;
+            m_random ^= m_random >> 7;
+            m_random ^= m_random << 17;
+
+            // uniform in ( 0, 1 ]
+            double uniform = ( double )( ( m_random >> 11 ) + 1 ) * ( 1.0 / 9007199254740992.0 );
+
+            return ( u64 )( -log( uniform ) * ( double )m_sampleInterval ) + 1;
+        }
+
+
+        /*====================================================================
+
+            HeapProfileStatsPolicy::GetSlot( const void* ptr )
+            - @return: the slot ptr is in, or the empty slot it would go in
+
+        ====================================================================*/
+        u32 HeapProfileStatsPolicy::GetSlot( const void* ptr ) const
+        {
+            u32 mask = m_capacity - 1;
+            u32 slot = ( u32 )( ( ( u64 )( size_t )ptr * 0x9E3779B97F4A7C15ull ) >> 32 ) & mask;
+
+            while( m_samples[ slot ].ptr && m_samples[ slot ].ptr != ptr )
+            {
+                slot = ( slot + 1 ) & mask;
+            }
+
+            return slot;
+        }
+
+
+        /*====================================================================
+
+            HeapProfileStatsPolicy::Grow
+            - doubles the sample table and rehashes every sample into it
+
+        ====================================================================*/
+        void HeapProfileStatsPolicy::Grow( )
+        {
+            heap_sample_s* oldSamples = m_samples;
+            u32 oldCapacity = m_capacity;
+
+            m_capacity = oldCapacity ? oldCapacity * 2 : 64;
+            m_samples = ( heap_sample_s* )calloc( m_capacity, sizeof( heap_sample_s ) );
+
+            if( m_samples == NULL )
+            {
+                m_samples = oldSamples;
+                m_capacity = oldCapacity;
+                return;
+            }
+
+            for( u32 i = 0; i < oldCapacity; ++i )
+            {
+                if( oldSamples[ i ].ptr )
+                {
+                    m_samples[ GetSlot( oldSamples[ i ].ptr ) ] = oldSamples[ i ];
+                }
+            }
+
+            free( oldSamples );
+        }
+
+
+        /*====================================================================
+
+            HeapProfileStatsPolicy::Sample( void* ptr, u32 blockSize )
+            - captures the stack of the allocation of ptr and picks the
+              distance to the next sample
+
+        ====================================================================*/
+        void HeapProfileStatsPolicy::Sample( void* ptr, u32 blockSize )
+        {
+            m_bytesUntilSample = NextSampleGap();
+
+            // keep the table at most half full so probes stay short
+            if( ( m_numSamples + 1 ) * 2 > m_capacity )
+            {
+                Grow();
+
+                if( ( m_numSamples + 1 ) * 2 > m_capacity )
+                {
+                    // out of memory for samples, drop this one
+                    return;
+                }
+            }
+
+            heap_sample_s& sample = m_samples[ GetSlot( ptr ) ];
+            sample.ptr = ptr;
+            sample.size = blockSize;
+            sample.numFrames = 0;
+
+#if defined( BB_HAS_BACKTRACE )
+            void* frames[ heap_sample_s::MAX_FRAMES + SKIPPED_FRAMES ];
+            int numFrames = backtrace( frames, heap_sample_s::MAX_FRAMES + SKIPPED_FRAMES );
+
+            for( int i = SKIPPED_FRAMES; i < numFrames; ++i )
+            {
+                sample.frames[ sample.numFrames++ ] = frames[ i ];
+            }
+#endif
+
+            ++m_numSamples;
+        }
+
+
+        /*====================================================================
+
+            HeapProfileStatsPolicy::RemoveSample( void* ptr )
+            - forgets ptr if it was sampled. later entries in the same probe
+              run are shifted back over the hole, so the table never needs
+              tombstones
+
+        ====================================================================*/
+        void HeapProfileStatsPolicy::RemoveSample( void* ptr )
+        {
+            u32 mask = m_capacity - 1;
+            u32 hole = GetSlot( ptr );
+
+            if( m_samples[ hole ].ptr == NULL )
+            {
+                // not sampled
+                return;
+            }
+
+            for( u32 slot = ( hole + 1 ) & mask; m_samples[ slot ].ptr; slot = ( slot + 1 ) & mask )
+            {
+                u32 home = ( u32 )( ( ( u64 )( size_t )m_samples[ slot ].ptr * 0x9E3779B97F4A7C15ull ) >> 32 ) & mask;
+
+                // move the entry back if its home slot isn't between the hole
+                // and where it is now
+                if( ( ( slot - home ) & mask ) >= ( ( slot - hole ) & mask ) )
+                {
+                    m_samples[ hole ] = m_samples[ slot ];
+                    hole = slot;
+                }
+            }
+
+            m_samples[ hole ].ptr = NULL;
+            --m_numSamples;
+        }
+
+
+        /*====================================================================
+
+            HeapProfileStatsPolicy::OnReset
+            - every block is gone, so every sample is too
+
+        ====================================================================*/
+        void HeapProfileStatsPolicy::OnReset( )
+        {
+            if( m_samples )
+            {
+                memset( m_samples, 0, sizeof( heap_sample_s ) * m_capacity );
+            }
+
+            m_numSamples = 0;
+        }
+
+
+        /*====================================================================
+
+            HeapProfileStatsPolicy::CopySamples( heap_sample_s*& samples )
+            - @return: number of samples copied into a malloc'd array
+
+        ====================================================================*/
+        u32 HeapProfileStatsPolicy::CopySamples( heap_sample_s*& samples ) const
+        {
+            samples = ( heap_sample_s* )malloc( sizeof( heap_sample_s ) * ( m_numSamples ? m_numSamples : 1 ) );
+
+            if( samples == NULL )
+            {
+                return 0;
+            }
+
+            u32 count = 0;
+
+            for( u32 i = 0; i < m_capacity; ++i )
+            {
+                if( m_samples[ i ].ptr )
+                {
+                    samples[ count++ ] = m_samples[ i ];
+                }
+            }
+
+            return count;
+        }
+
+
+        static int CompareStacks( const void* a, const void* b )
+        {
+            const heap_sample_s* first = ( const heap_sample_s* )a;
+            const heap_sample_s* second = ( const heap_sample_s* )b;
+
+            if( first->numFrames != second->numFrames )
+            {
+                return first->numFrames < second->numFrames ? -1 : 1;
+            }
+
+            return memcmp( first->frames, second->frames, sizeof( void* ) * first->numFrames );
+        }
+
+
+        /*====================================================================
+
+            HeapProfile_Write
+            - sorts samples by stack and writes one line per unique stack
+            - format:
+                heap profile: <objects>: <bytes> [ <objects>: <bytes>] @ heap_v2/<interval>
+                <objects>: <bytes> [ <objects>: <bytes>] @ <pc> <pc> ...
+                ...
+                MAPPED_LIBRARIES:
+                <contents of /proc/self/maps>
+            - the bracketed allocated counts are the same as the in use ones,
+              since only live samples are kept
+            - @return: false if the file could not be written
+
+        ====================================================================*/
+        bool HeapProfile_Write( const char* path, heap_sample_s* samples, u32 numSamples, u32 sampleInterval )
+        {
+            FILE* file = fopen( path, "w" );
+
+            if( file == NULL )
+            {
+                return false;
+            }
+
+            qsort( samples, numSamples, sizeof( heap_sample_s ), CompareStacks );
+
+            u64 totalBytes = 0;
+
+            for( u32 i = 0; i < numSamples; ++i )
+            {
+                totalBytes += samples[ i ].size;
+            }
+
+            fprintf( file, "heap profile: %u: %llu [%u: %llu] @ heap_v2/%u\n",
+                     numSamples, ( unsigned long long )totalBytes, numSamples, ( unsigned long long )totalBytes, sampleInterval );
+
+            for( u32 i = 0; i < numSamples; )
+            {
+                u32 objects = 0;
+                u64 bytes = 0;
+                u32 first = i;
+
+                while( i < numSamples && CompareStacks( &samples[ first ], &samples[ i ] ) == 0 )
+                {
+                    ++objects;
+                    bytes += samples[ i ].size;
+                    ++i;
+                }
+
+                fprintf( file, "%u: %llu [%u: %llu] @", objects, ( unsigned long long )bytes, objects, ( unsigned long long )bytes );
+
+                for( u32 frame = 0; frame < samples[ first ].numFrames; ++frame )
+                {
+                    fprintf( file, " %p", samples[ first ].frames[ frame ] );
+                }
+
+                fprintf( file, "\n" );
+            }
+
+            // pprof needs the load addresses of the binary and shared
+            // libraries to map the stacks back to symbols
+            FILE* maps = fopen( "/proc/self/maps", "r" );
+
+            if( maps )
+            {
+                fprintf( file, "\nMAPPED_LIBRARIES:\n" );
+
+                char buffer[ 4096 ];
+                size_t numRead;
+
+                while( ( numRead = fread( buffer, 1, sizeof( buffer ), maps ) ) > 0 )
+                {
+                    fwrite( buffer, 1, numRead, file );
+                }
+
+                fclose( maps );
+            }
+
+            return fclose( file ) == 0;
+        }
+    }
+}
@@ -0,0 +1,104 @@
+#ifndef _BB_HEAP_PROFILER_H_ // [ _BB_HEAP_PROFILER_H_
+#define _BB_HEAP_PROFILER_H_
+
+#include "engine/memory/FreeListPolicies.h"
+#include <stdio.h>
+
+namespace bbengine
+{
+    namespace mem
+    {
+        // a sampled block that is still in use
+        struct heap_sample_s
+        {
+            static const u32 MAX_FRAMES = 32;
+
+            void*   ptr;
+            u32     size;                   // usable size of the block
+            u32     numFrames;
+            void*   frames[ MAX_FRAMES ];   // return addresses, innermost first
+        };
+
+
+        // StatsPolicy that samples allocations and keeps the callstack of
+        // each sampled block until it is freed. samples are taken on
+        // average once every sampleInterval bytes, with exponentially
+        // distributed gaps between them ( Poisson sampling ), so every
+        // byte is equally likely to be sampled and large blocks are
+        // sampled more often than small ones. the profile is scaled back
+        // up to the whole heap by pprof using the interval.
+        //
+        // the common path is a subtract and a compare on allocate and a
+        // compare on free. only sampled blocks pay for a backtrace and a
+        // table entry. the table is allocated with malloc, never from the
+        // heap being profiled
+        class HeapProfileStatsPolicy : public NullStatsPolicy
+        {
+        public:
+            HeapProfileStatsPolicy( );
+            ~HeapProfileStatsPolicy( );
+
+            void OnAllocate( void* ptr, u32 blockSize, u32 tag )
+            {
+                ( void )tag;
+
+                if( blockSize < m_bytesUntilSample )
+                {
+                    m_bytesUntilSample -= blockSize;
+                    return;
+                }
+
+                Sample( ptr, blockSize );
+            }
+
+            void OnFree( void* ptr, u32 blockSize, u32 tag )
+            {
+                ( void )blockSize; ( void )tag;
+
+                if( m_numSamples )
+                {
+                    RemoveSample( ptr );
+                }
+            }
+
+            void OnReset( );
+
+            // starts sampling on average every sampleInterval bytes. 0 stops
+            // sampling, but blocks already sampled are kept until freed
+            void            SetSampleInterval( u32 sampleInterval );
+            u32             GetSampleInterval( ) const      { return m_sampleInterval; }
+
+            // copies the live samples into a malloc'd array that must be
+            // released with free, so the profile can be written out without
+            // holding the allocator's lock. @return: number of samples
+            u32             CopySamples( heap_sample_s*& samples ) const;
+
+        private:
+            HeapProfileStatsPolicy( HeapProfileStatsPolicy& );
+
+            void            Sample( void* ptr, u32 blockSize );
+            void            RemoveSample( void* ptr );
+            void            Grow( );
+            u64             NextSampleGap( );
+            u32             GetSlot( const void* ptr ) const;
+
+            u64             m_bytesUntilSample;
+            u32             m_sampleInterval;
+            u64             m_random;
+
+            heap_sample_s*  m_samples;          // open addressed on ptr, NULL ptr for an empty slot
+            u32             m_capacity;         // power of two
+            u32             m_numSamples;
+        };
+
+
+        // writes samples as a pprof heap profile ( the legacy text format,
+        // "heap_v2" ) followed by the process' mapped libraries so pprof can
+        // symbolize the stacks. samples with the same stack are merged.
+        // @return: false if the file could not be written
+        bool HeapProfile_Write( const char* path, heap_sample_s* samples, u32 numSamples, u32 sampleInterval );
+    }
+}
+
+
+#endif // ] _BB_HEAP_PROFILER_H_
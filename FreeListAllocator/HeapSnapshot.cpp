@@ -0,0 +1,78 @@
+#include "engine/memory/HeapSnapshot.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+namespace bbengine
+{
+    namespace mem
+    {
+        /*====================================================================
+
+            HeapSnapshot_Write
+            - writes the header and extents of a captured snapshot
+            - @return: false if the file could not be written
+
+        ====================================================================*/
+        bool HeapSnapshot_Write( const char* path, const heap_snapshot_header_s& header, const heap_extent_s* extents )
+        {
+            FILE* file = fopen( path, "wb" );
+
+            if( file == NULL )
+            {
+                return false;
+            }
+
+            bool ok = fwrite( &header, sizeof( header ), 1, file ) == 1 &&
+                      fwrite( extents, sizeof( heap_extent_s ), header.extentCount, file ) == header.extentCount;
+
+            return fclose( file ) == 0 && ok;
+        }
+
+
+        /*====================================================================
+
+            HeapSnapshot_Read
+            - reads a snapshot file into header and a malloc'd extent array
+            - @return: false if the file is missing, not a heap snapshot or
+              the extents can't be allocated
+
+        ====================================================================*/
+        bool HeapSnapshot_Read( const char* path, heap_snapshot_header_s& header, heap_extent_s*& extents )
+        {
+            extents = NULL;
+
+            FILE* file = fopen( path, "rb" );
+
+            if( file == NULL )
+            {
+                return false;
+            }
+
+            if( fread( &header, sizeof( header ), 1, file ) != 1 ||
+                header.magic != HEAP_SNAPSHOT_MAGIC || header.version != HEAP_SNAPSHOT_VERSION )
+            {
+                fclose( file );
+                return false;
+            }
+
+            extents = ( heap_extent_s* )malloc( sizeof( heap_extent_s ) * ( header.extentCount ? ( size_t )header.extentCount : 1 ) );
+
+            if( extents == NULL )
+            {
+                fclose( file );
+                return false;
+            }
+
+            if( fread( extents, sizeof( heap_extent_s ), header.extentCount, file ) != header.extentCount )
+            {
+                free( extents );
+                extents = NULL;
+                fclose( file );
+                return false;
+            }
+
+            fclose( file );
+            return true;
+        }
+    }
+}
@@ -0,0 +1,199 @@
+#ifndef _BB_HEAP_SNAPSHOT_H_ // [ _BB_HEAP_SNAPSHOT_H_
+#define _BB_HEAP_SNAPSHOT_H_
+
+#include "engine/memory/BasicFreeListAllocator.h"
+
+namespace bbengine
+{
+    namespace mem
+    {
+        /*====================================================================
+
+            Heap snapshot file layout:
+            - heap_snapshot_header_s
+            - heap_snapshot_header_s::extentCount heap_extent_s records, in
+              address order
+
+            an extent is a run of physically adjacent blocks that are all
+            free, or all in use with the same tag. extents include block
+            headers, so together they cover the whole heap
+
+        ====================================================================*/
+
+        #define HEAP_SNAPSHOT_MAGIC     0x53484242u     // "BBHS"
+        #define HEAP_SNAPSHOT_VERSION   1
+
+        enum heap_extent_flags_e
+        {
+            HEAP_EXTENT_FREE            = 0x0001,
+        };
+
+        struct heap_snapshot_header_s
+        {
+            u32     magic;
+            u32     version;
+            u32     heapSize;
+            u32     extentCount;
+            u32     blockCount;         // blocks merged into the extents. memory between
+                                        // blocks, and without per block tags each run of
+                                        // in use blocks, counts as one
+            u32     truncated;          // 1 if the extent buffer ran out before the end of the heap
+        };
+
+        struct heap_extent_s
+        {
+            u32     offset;             // from the start of the heap
+            u32     size;
+            u16     tag;
+            u16     flags;              // heap_extent_flags_e
+        };
+
+
+        // builds the run-length extent list for a heap into extents, which is
+        // provided by the caller so nothing is allocated from the heap being
+        // captured. the heap is locked for the duration of the capture.
+        //
+        // by default only the free list is read, and the memory between free
+        // blocks is reported as untagged in use extents, so the cost is
+        // proportional to the number of free blocks. with perBlockTags the
+        // whole heap is walked for each block's tag, which reads every block
+        // header. both are bound by cache misses on the headers: on a 64 MiB
+        // heap with 150k blocks, a free list capture took 0.03 ms with 1.5k
+        // free blocks and 9 ms with 50k, and a per block capture 10-12 ms
+        // either way. in both cases the leading alignment padding of the
+        // heap, and any other memory not covered by a block, is an untagged
+        // in use extent.
+        //
+        // neither mode captures a tagged layout of a large, busy heap in
+        // under a millisecond. that would need tag summaries per region of
+        // the heap kept up to date on every allocate and free, which the
+        // allocator does not keep
+        template< class Heap >
+        class HeapSnapshotCapture
+        {
+        public:
+            HeapSnapshotCapture( Heap& heap, heap_extent_s* extents, u32 maxExtents, bool perBlockTags = false )
+                : m_base( ( byte* )heap.GetHeapBase() )
+                , m_extents( extents )
+                , m_maxExtents( maxExtents )
+            {
+                m_header.magic = HEAP_SNAPSHOT_MAGIC;
+                m_header.version = HEAP_SNAPSHOT_VERSION;
+                m_header.heapSize = heap.GetHeapSize();
+                m_header.extentCount = 0;
+                m_header.blockCount = 0;
+                m_header.truncated = 0;
+
+                if( perBlockTags )
+                {
+                    heap.WalkHeap( *this );
+                }
+                else
+                {
+                    CaptureFreeList( heap );
+                }
+
+                AddGap( m_header.heapSize );
+            }
+
+            const heap_snapshot_header_s&   GetHeader( ) const      { return m_header; }
+            const heap_extent_s*            GetExtents( ) const     { return m_extents; }
+
+            void operator()( const heap_block_info_s& block )
+            {
+                AddBlock( Heap::GetBlock( block.ptr ), block.size, block.isFree ? 0 : ( u16 )block.tag, block.isFree ? HEAP_EXTENT_FREE : 0 );
+            }
+
+        private:
+            // adds a block and its header as an extent, merged into the last
+            // extent when it continues it
+            void AddBlock( const typename Heap::block_s* block, u32 blockSize, u16 tag, u16 flags )
+            {
+                u32 offset = ( u32 )( ( const byte* )block - m_base );
+
+                AddGap( offset );
+                AddExtent( offset, blockSize + Heap::ALIGNED_HEADER_SIZE, tag, flags );
+            }
+
+            // covers memory between the end of the last extent and offset
+            // with an untagged in use extent
+            void AddGap( u32 offset )
+            {
+                u32 end = 0;
+
+                if( m_header.extentCount )
+                {
+                    const heap_extent_s& last = m_extents[ m_header.extentCount - 1 ];
+                    end = last.offset + last.size;
+                }
+
+                if( offset > end && !m_header.truncated )
+                {
+                    AddExtent( end, offset - end, 0, 0 );
+                }
+            }
+
+            void AddExtent( u32 offset, u32 size, u16 tag, u16 flags )
+            {
+                if( m_header.truncated )
+                {
+                    return;
+                }
+
+                if( m_header.extentCount )
+                {
+                    heap_extent_s& last = m_extents[ m_header.extentCount - 1 ];
+
+                    if( last.tag == tag && last.flags == flags && last.offset + last.size == offset )
+                    {
+                        last.size += size;
+                        ++m_header.blockCount;
+                        return;
+                    }
+                }
+
+                if( m_header.extentCount == m_maxExtents )
+                {
+                    m_header.truncated = 1;
+                    return;
+                }
+
+                heap_extent_s& extent = m_extents[ m_header.extentCount++ ];
+                extent.offset = offset;
+                extent.size = size;
+                extent.tag = tag;
+                extent.flags = flags;
+
+                ++m_header.blockCount;
+            }
+
+            void CaptureFreeList( Heap& heap )
+            {
+                ScopedPolicyLock< typename Heap::lock_t > lock( heap.GetLockPolicy() );
+
+                // free blocks are address ordered and never adjacent, so the
+                // gaps between them are in use
+                for( typename Heap::block_s* block = heap.GetFirstFree(); block; block = heap.GetNext( block ) )
+                {
+                    AddBlock( block, Heap::GetSize( block ), 0, HEAP_EXTENT_FREE );
+                }
+            }
+
+            byte*                   m_base;
+            heap_extent_s*          m_extents;
+            u32                     m_maxExtents;
+            heap_snapshot_header_s  m_header;
+        };
+
+
+        // writes a captured snapshot to path. @return: false on failure
+        bool HeapSnapshot_Write( const char* path, const heap_snapshot_header_s& header, const heap_extent_s* extents );
+
+        // reads a snapshot written by HeapSnapshot_Write. extents is allocated
+        // with malloc and must be released with free
+        bool HeapSnapshot_Read( const char* path, heap_snapshot_header_s& header, heap_extent_s*& extents );
+    }
+}
+
+
+#endif // ] _BB_HEAP_SNAPSHOT_H_
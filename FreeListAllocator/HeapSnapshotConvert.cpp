@@ -0,0 +1,175 @@
+/*====================================================================
+
+    HeapSnapshotConvert
+    - converts a heap snapshot written by HeapSnapshot_Write to JSON for
+      the timeline viewer or to a PPM image of the heap layout
+
+    usage: HeapSnapshotConvert <snapshot> <output.json | output.ppm> [width]
+
+    in the image each pixel covers an equal slice of the heap, left to
+    right and top to bottom. free memory is black, and in use memory is
+    colored by tag, dimmed by how much of the slice is free
+
+====================================================================*/
+#include "engine/memory/HeapSnapshot.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace bbengine;
+using namespace bbengine::mem;
+
+namespace
+{
+    bool WriteJson( const char* path, const heap_snapshot_header_s& header, const heap_extent_s* extents )
+    {
+        FILE* file = fopen( path, "w" );
+
+        if( file == NULL )
+        {
+            return false;
+        }
+
+        fprintf( file, "{\n  \"heap_size\": %u,\n  \"block_count\": %u,\n  \"truncated\": %s,\n  \"extents\": [",
+                 header.heapSize, header.blockCount, header.truncated ? "true" : "false" );
+
+        for( u32 i = 0; i < header.extentCount; ++i )
+        {
+            fprintf( file, "%s\n    { \"offset\": %u, \"size\": %u, \"free\": %s, \"tag\": %u }", i ? "," : "",
+                     extents[ i ].offset, extents[ i ].size, ( extents[ i ].flags & HEAP_EXTENT_FREE ) ? "true" : "false",
+                     extents[ i ].tag );
+        }
+
+        fprintf( file, "\n  ]\n}\n" );
+
+        return fclose( file ) == 0;
+    }
+
+
+    // spreads tags around the color wheel so neighbouring tags look different
+    void TagColor( u16 tag, byte* rgb )
+    {
+        u32 hash = ( tag + 1 ) * 2654435761u;
+
+        rgb[ 0 ] = ( byte )( 96 + ( ( hash >> 8 ) & 0x9F ) );
+        rgb[ 1 ] = ( byte )( 96 + ( ( hash >> 16 ) & 0x9F ) );
+        rgb[ 2 ] = ( byte )( 96 + ( ( hash >> 24 ) & 0x9F ) );
+    }
+
+
+    bool WritePpm( const char* path, const heap_snapshot_header_s& header, const heap_extent_s* extents, u32 width )
+    {
+        u32 height = width / 2;
+        u64 pixels = ( u64 )width * height;
+        u64 bytesPerPixel = ( header.heapSize + pixels - 1 ) / pixels;
+
+        if( bytesPerPixel == 0 )
+        {
+            bytesPerPixel = 1;
+        }
+
+        FILE* file = fopen( path, "wb" );
+
+        if( file == NULL )
+        {
+            return false;
+        }
+
+        fprintf( file, "P6\n%u %u\n255\n", width, height );
+
+        u32 extent = 0;
+
+        for( u64 pixel = 0; pixel < pixels; ++pixel )
+        {
+            u64 start = pixel * bytesPerPixel;
+            u64 end = start + bytesPerPixel;
+
+            u64 usedBytes = 0;
+            u64 largestUsed = 0;
+            u16 tag = 0;
+
+            // extents are in address order, so only ever move forward
+            while( extent < header.extentCount && ( u64 )extents[ extent ].offset + extents[ extent ].size <= start )
+            {
+                ++extent;
+            }
+
+            for( u32 i = extent; i < header.extentCount && extents[ i ].offset < end; ++i )
+            {
+                u64 overlapStart = extents[ i ].offset > start ? extents[ i ].offset : start;
+                u64 overlapEnd = ( u64 )extents[ i ].offset + extents[ i ].size < end ? ( u64 )extents[ i ].offset + extents[ i ].size : end;
+                u64 overlap = overlapEnd - overlapStart;
+
+                if( !( extents[ i ].flags & HEAP_EXTENT_FREE ) )
+                {
+                    usedBytes += overlap;
+
+                    if( overlap > largestUsed )
+                    {
+                        largestUsed = overlap;
+                        tag = extents[ i ].tag;
+                    }
+                }
+            }
+
+            byte rgb[ 3 ] = { 0, 0, 0 };
+
+            if( usedBytes )
+            {
+                TagColor( tag, rgb );
+
+                for( u32 c = 0; c < 3; ++c )
+                {
+                    rgb[ c ] = ( byte )( rgb[ c ] * usedBytes / bytesPerPixel );
+                }
+            }
+
+            fwrite( rgb, 1, 3, file );
+        }
+
+        return fclose( file ) == 0;
+    }
+}
+
+
+int main( int argc, char** argv )
+{
+    if( argc < 3 )
+    {
+        fprintf( stderr, "usage: %s <snapshot> <output.json | output.ppm> [width]\n", argv[ 0 ] );
+        return 1;
+    }
+
+    heap_snapshot_header_s header;
+    heap_extent_s* extents = NULL;
+
+    if( !HeapSnapshot_Read( argv[ 1 ], header, extents ) )
+    {
+        fprintf( stderr, "%s is not a heap snapshot\n", argv[ 1 ] );
+        return 1;
+    }
+
+    const char* output = argv[ 2 ];
+    size_t length = strlen( output );
+    bool ok = false;
+
+    if( length > 4 && strcmp( output + length - 4, ".ppm" ) == 0 )
+    {
+        u32 width = argc > 3 ? ( u32 )atoi( argv[ 3 ] ) : 1024;
+        ok = WritePpm( output, header, extents, width < 2 ? 2 : width );
+    }
+    else
+    {
+        ok = WriteJson( output, header, extents );
+    }
+
+    free( extents );
+
+    if( !ok )
+    {
+        fprintf( stderr, "unable to write %s\n", output );
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,118 @@
+#ifndef _BB_LOG_HISTOGRAM_H_ // [ _BB_LOG_HISTOGRAM_H_
+#define _BB_LOG_HISTOGRAM_H_
+
+#include "engine/system/System.h"
+#include <atomic>
+#include <stdio.h>
+
+#if defined( __i386__ ) || defined( __x86_64__ )
+    #include <x86intrin.h>
+#elif !defined( __aarch64__ )
+    #include <time.h>
+#endif
+
+namespace bbengine
+{
+    namespace mem
+    {
+        // reads a cheap, monotonic cycle counter. TSC on x86, the virtual
+        // counter on arm64 and nanoseconds elsewhere. only differences
+        // between two reads on the same thread are meaningful
+        inline u64 ReadCycleCounter( )
+        {
+#if defined( __i386__ ) || defined( __x86_64__ )
+            return __rdtsc();
+#elif defined( __aarch64__ )
+            u64 value;
+            __asm__ __volatile__( "mrs %0, cntvct_el0" : "=r"( value ) );
+            return value;
+#else
+            struct timespec ts;
+            clock_gettime( CLOCK_MONOTONIC, &ts );
+            return ( u64 )ts.tv_sec * 1000000000ull + ( u64 )ts.tv_nsec;
+#endif
+        }
+
+
+        // Histogram with power of two buckets. bucket 0 counts zeros and
+        // bucket i counts values in [ 2^(i-1), 2^i ). Record is a single
+        // relaxed atomic add, so any number of threads can record into
+        // the same histogram while another thread takes snapshots
+        class LogHistogram
+        {
+        public:
+            static const u32 NUM_BUCKETS = 65;
+
+            struct snapshot_s
+            {
+                u64     buckets[ NUM_BUCKETS ];
+                u64     count;
+                u64     total;
+            };
+
+            LogHistogram( )
+            {
+                for( u32 i = 0; i < NUM_BUCKETS; ++i )
+                {
+                    m_buckets[ i ].store( 0, std::memory_order_relaxed );
+                }
+
+                m_total.store( 0, std::memory_order_relaxed );
+            }
+
+            void Record( u64 value )
+            {
+                u32 bucket = value ? 64 - __builtin_clzll( value ) : 0;
+
+                m_buckets[ bucket ].fetch_add( 1, std::memory_order_relaxed );
+                m_total.fetch_add( value, std::memory_order_relaxed );
+            }
+
+            // copies the counts out. with reset set, the counts are zeroed
+            // as they are read so each snapshot covers one interval ( ie a
+            // frame or a second )
+            void Snapshot( snapshot_s& snapshot, bool reset )
+            {
+                snapshot.count = 0;
+
+                for( u32 i = 0; i < NUM_BUCKETS; ++i )
+                {
+                    snapshot.buckets[ i ] = reset ? m_buckets[ i ].exchange( 0, std::memory_order_relaxed )
+                                                  : m_buckets[ i ].load( std::memory_order_relaxed );
+                    snapshot.count += snapshot.buckets[ i ];
+                }
+
+                snapshot.total = reset ? m_total.exchange( 0, std::memory_order_relaxed )
+                                       : m_total.load( std::memory_order_relaxed );
+            }
+
+            // writes the non-empty buckets of a snapshot as "[low, high) count" lines
+            static void Print( FILE* file, const char* name, const snapshot_s& snapshot )
+            {
+                fprintf( file, "%s: count %llu mean %.1f\n", name, ( unsigned long long )snapshot.count,
+                         snapshot.count ? ( double )snapshot.total / ( double )snapshot.count : 0.0 );
+
+                for( u32 i = 0; i < NUM_BUCKETS; ++i )
+                {
+                    if( snapshot.buckets[ i ] )
+                    {
+                        u64 low = i ? 1ull << ( i - 1 ) : 0;
+                        u64 high = i ? ( i < 64 ? 1ull << i : ~0ull ) : 1;
+
+                        fprintf( file, "  [%llu, %llu) %llu\n", ( unsigned long long )low, ( unsigned long long )high,
+                                 ( unsigned long long )snapshot.buckets[ i ] );
+                    }
+                }
+            }
+
+        private:
+            LogHistogram( LogHistogram& );
+
+            std::atomic< u64 >  m_buckets[ NUM_BUCKETS ];
+            std::atomic< u64 >  m_total;
+        };
+    }
+}
+
+
+#endif // ] _BB_LOG_HISTOGRAM_H_
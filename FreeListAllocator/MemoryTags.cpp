@@ -0,0 +1,9 @@
+#include "engine/memory/MemoryTags.h"
+
+namespace bbengine
+{
+    namespace mem
+    {
+        thread_local memtag_t g_currentMemTag = MEM_TAG_NONE;
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef _BB_MEMORY_TAGS_H_ // [ _BB_MEMORY_TAGS_H_
+#define _BB_MEMORY_TAGS_H_
+
+#include "engine/system/System.h"
+
+namespace bbengine
+{
+    namespace mem
+    {
+        /*====================================================================
+
+            Memory tags say which subsystem ( audio, physics, UI, ... ) an
+            allocation belongs to. The game defines its own tag values,
+            from 1 up to MAX_MEM_TAGS - 1. MEM_TAG_NONE is used for
+            allocations made without a tag.
+
+            Allocations take the calling thread's current tag unless one is
+            passed to AllocateAligned explicitly.
+
+        ====================================================================*/
+
+        typedef u16 memtag_t;
+
+        const memtag_t  MEM_TAG_NONE    = 0;
+        const u32       MAX_MEM_TAGS    = 64;
+
+        extern thread_local memtag_t g_currentMemTag;
+
+        // @return: the tag given to allocations made by the calling thread
+        inline memtag_t MemTag_GetCurrent( )
+        {
+            return g_currentMemTag;
+        }
+
+        // sets the calling thread's current tag. @return: the previous tag
+        inline memtag_t MemTag_SetCurrent( memtag_t tag )
+        {
+            memtag_t previous = g_currentMemTag;
+            g_currentMemTag = tag;
+            return previous;
+        }
+
+        // sets the calling thread's current tag for the lifetime of a scope
+        class ScopedMemTag
+        {
+        public:
+            explicit ScopedMemTag( memtag_t tag ) : m_previous( MemTag_SetCurrent( tag ) )  {}
+            ~ScopedMemTag( )                                                            { MemTag_SetCurrent( m_previous ); }
+
+        private:
+            ScopedMemTag( ScopedMemTag& );
+
+            memtag_t    m_previous;
+        };
+    }
+}
+
+
+#endif // ] _BB_MEMORY_TAGS_H_
@@ -0,0 +1,402 @@
+#include "engine/memory/OutOfBandFreeListAllocator.h"
+#include "engine/system/Assert.h"
+#include <stdlib.h>
+#include <string.h>
+
+namespace bbengine
+{
+    namespace mem
+    {
+        #define INVALID_INDEX   0xFFFFFFFFu
+
+
+        /*====================================================================
+
+            OutOfBandFreeListAllocator::OutOfBandFreeListAllocator
+            - allocates memory buffer based on heapSize
+            - maxBlocks is the maximum number of blocks that can be in use
+              at once and sizes the metadata tables
+            - if the heap cannot be allocated the allocator is left empty
+
+        ====================================================================*/
+        OutOfBandFreeListAllocator::OutOfBandFreeListAllocator( u32 heapSize, u32 maxBlocks )
+        {
+            void* memory = malloc( heapSize );
+
+            m_ownsMemory = Init( memory, heapSize, maxBlocks );
+
+            if( !m_ownsMemory )
+            {
+                free( memory );
+            }
+        }
+
+
+        /*====================================================================
+
+            OutOfBandFreeListAllocator::OutOfBandFreeListAllocator
+            - manages memory that is owned elsewhere. the memory is never
+              read or written, only handed out
+
+        ====================================================================*/
+        OutOfBandFreeListAllocator::OutOfBandFreeListAllocator( void* memory, u32 memorySize, u32 maxBlocks )
+        {
+            Init( memory, memorySize, maxBlocks );
+            m_ownsMemory = false;
+        }
+
+
+        /*====================================================================
+
+            OutOfBandFreeListAllocator::~OutOfBandFreeListAllocator
+            - releases the metadata tables and, if owned, the heap
+
+        ====================================================================*/
+        OutOfBandFreeListAllocator::~OutOfBandFreeListAllocator()
+        {
+            if( m_ownsMemory )
+            {
+                free( m_base );
+            }
+
+            // all tables share a single allocation
+            free( m_freeOffsets );
+
+            m_base = NULL;
+            m_freeOffsets = NULL;
+        }
+
+
+        /*====================================================================
+
+            OutOfBandFreeListAllocator::Init
+            - allocates the metadata tables and sets up the free table as a
+              single block spanning the managed memory
+            - @return: false if there is no memory to manage or the tables
+              could not be allocated. the allocator is then left empty, so
+              every allocation fails and IsInitialized returns false
+
+        ====================================================================*/
+        bool OutOfBandFreeListAllocator::Init( void* memory, u32 memorySize, u32 maxBlocks )
+        {
+            m_ownsMemory = false;
+            m_numFree = 0;
+            m_numUsed = 0;
+
+            // free blocks are always coalesced, so there can never be more
+            // than one free block per used block plus one at the end
+            u32* tables = memory ? ( u32* )malloc( sizeof( u32 ) * ( 4 * ( size_t )maxBlocks + 2 ) ) : NULL;
+
+            if( tables == NULL )
+            {
+                m_base = NULL;
+                m_size = 0;
+                m_maxBlocks = 0;
+                m_freeOffsets = m_freeSizes = m_usedOffsets = m_usedSizes = NULL;
+
+                return false;
+            }
+
+            m_base = ( byte* )memory;
+            m_size = memorySize;
+            m_maxBlocks = maxBlocks;
+
+            m_freeOffsets = tables;
+            m_freeSizes   = m_freeOffsets + maxBlocks + 1;
+            m_usedOffsets = m_freeSizes + maxBlocks + 1;
+            m_usedSizes   = m_usedOffsets + maxBlocks;
+
+            Reset();
+
+            return true;
+        }
+
+
+        /*====================================================================
+
+            OutOfBandFreeListAllocator::Reset
+            - releases every allocation by resetting the tables
+
+        ====================================================================*/
+        void OutOfBandFreeListAllocator::Reset( )
+        {
+            // blocks start on the first 8-byte aligned address
+            size_t misalignment = ( size_t )m_base & ( ALIGN_8 - 1 );
+            u32 padding = misalignment ? ( u32 )( ALIGN_8 - misalignment ) : 0;
+
+            m_numUsed = 0;
+            m_numFree = 0;
+
+            if( m_freeOffsets && padding < m_size )
+            {
+                m_freeOffsets[ 0 ] = padding;
+                m_freeSizes[ 0 ] = ( m_size - padding ) & ~( ALIGN_8 - 1 );
+                m_numFree = 1;
+            }
+        }
+
+
+        /*====================================================================
+
+            OutOfBandFreeListAllocator::Allocate( u32 numBytes)
+            - Allocate 8-byte aligned memory of numBytes size.
+            - @return: returns pointer to memory aligned block
+
+        ====================================================================*/
+        void* OutOfBandFreeListAllocator::Allocate( u32 numBytes )
+        {
+            return AllocateAligned( numBytes, ALIGN_8 );
+        }
+
+
+        /*====================================================================
+
+            OutOfBandFreeListAllocator::AllocateAligned( u32 numBytes, const align_t alignment)
+            - Allocate aligned memory of numBytes size.
+            - uses a First Fit Policy over the dense free size table. with no
+              header in front of the block, the returned address is aligned
+              to alignment rather than just the size
+            - @return: returns pointer to memory aligned block
+
+        ====================================================================*/
+        void* OutOfBandFreeListAllocator::AllocateAligned( u32 numBytes, const align_t alignment )
+        {
+            if( m_numUsed == m_maxBlocks )
+            {
+                // no room left to track another block
+                return NULL;
+            }
+
+            u32 sizeNeeded = MemUtils_Align( numBytes ? numBytes : 1, ALIGN_8 );
+            u32 padding = 0;
+            u32 index = 0;
+
+            for( ; index < m_numFree; ++index )
+            {
+                if( sizeNeeded > m_freeSizes[ index ] )
+                {
+                    continue;
+                }
+
+                // bytes needed to bring the start of the block up to alignment.
+                // always a multiple of 8 since blocks start 8-byte aligned
+                size_t addr = ( size_t )( m_base + m_freeOffsets[ index ] );
+                padding = ( u32 )( ( alignment - ( addr & ( alignment - 1 ) ) ) & ( alignment - 1 ) );
+
+                if( padding + sizeNeeded <= m_freeSizes[ index ] )
+                {
+                    break;
+                }
+            }
+
+            if( index == m_numFree )
+            {
+                // No blocks large enough to fit memory request
+                return NULL;
+            }
+
+            u32 offset = m_freeOffsets[ index ] + padding;
+            u32 remaining = m_freeSizes[ index ] - padding - sizeNeeded;
+
+            // any bytes skipped for alignment stay as a free block in place,
+            // and anything left after the allocation becomes a new free block
+            if( padding )
+            {
+                m_freeSizes[ index ] = padding;
+
+                if( remaining )
+                {
+                    InsertFree( index + 1, offset + sizeNeeded, remaining );
+                }
+            }
+            else if( remaining )
+            {
+                m_freeOffsets[ index ] = offset + sizeNeeded;
+                m_freeSizes[ index ] = remaining;
+            }
+            else
+            {
+                RemoveFree( index );
+            }
+
+            // track the block in the used table. inserting shifts every
+            // block above it up one entry, see the class comment
+            u32 usedIndex = LowerBound( m_usedOffsets, m_numUsed, offset );
+
+            memmove( m_usedOffsets + usedIndex + 1, m_usedOffsets + usedIndex, ( m_numUsed - usedIndex ) * sizeof( u32 ) );
+            memmove( m_usedSizes + usedIndex + 1, m_usedSizes + usedIndex, ( m_numUsed - usedIndex ) * sizeof( u32 ) );
+
+            m_usedOffsets[ usedIndex ] = offset;
+            m_usedSizes[ usedIndex ] = sizeNeeded;
+            ++m_numUsed;
+
+            return m_base + offset;
+        }
+
+
+        /*====================================================================
+
+            OutOfBandFreeListAllocator::Free( void* ptr )
+            - frees the specified block of memory and returns it to the free
+              table, coalescing with adjacent free blocks
+            - pointers that are not the start of an in use block fail an
+              assertion and are ignored
+
+        ====================================================================*/
+        void OutOfBandFreeListAllocator::Free( void* ptr )
+        {
+            if ( ptr == NULL )
+            {
+                // trying to free a NULL ptr
+                return;
+            }
+
+            u32 usedIndex = FindUsedBlock( ptr );
+
+            if( usedIndex == INVALID_INDEX )
+            {
+                DEBUG_ASSERT( false && "Trying to free a ptr that is not an in use block" );
+                return;
+            }
+
+            u32 offset = m_usedOffsets[ usedIndex ];
+            u32 size = m_usedSizes[ usedIndex ];
+
+            memmove( m_usedOffsets + usedIndex, m_usedOffsets + usedIndex + 1, ( m_numUsed - usedIndex - 1 ) * sizeof( u32 ) );
+            memmove( m_usedSizes + usedIndex, m_usedSizes + usedIndex + 1, ( m_numUsed - usedIndex - 1 ) * sizeof( u32 ) );
+            --m_numUsed;
+
+            // find adjacent free blocks based on address
+            u32 index = LowerBound( m_freeOffsets, m_numFree, offset );
+
+            bool joinPrev = index > 0 && m_freeOffsets[ index - 1 ] + m_freeSizes[ index - 1 ] == offset;
+            bool joinNext = index < m_numFree && offset + size == m_freeOffsets[ index ];
+
+            if( joinPrev && joinNext )
+            {
+                m_freeSizes[ index - 1 ] += size + m_freeSizes[ index ];
+                RemoveFree( index );
+            }
+            else if( joinPrev )
+            {
+                m_freeSizes[ index - 1 ] += size;
+            }
+            else if( joinNext )
+            {
+                m_freeOffsets[ index ] = offset;
+                m_freeSizes[ index ] += size;
+            }
+            else
+            {
+                InsertFree( index, offset, size );
+            }
+        }
+
+
+        /*====================================================================
+
+            OutOfBandFreeListAllocator::GetBlockSize( void* ptr )
+            - @return: size of specified block of memory
+
+        ====================================================================*/
+        u32 OutOfBandFreeListAllocator::GetBlockSize( void* ptr )
+        {
+            DEBUG_ASSERT( ptr != NULL && "Trying to get size of a NULL ptr" );
+
+            u32 usedIndex = FindUsedBlock( ptr );
+
+            DEBUG_ASSERT( usedIndex != INVALID_INDEX && "Trying to get size of a ptr that is not an in use block" );
+
+            return usedIndex != INVALID_INDEX ? m_usedSizes[ usedIndex ] : 0;
+        }
+
+
+        /*====================================================================
+
+            OutOfBandFreeListAllocator::LowerBound
+            - binary search over a sorted offset table
+            - @return: index of the first entry not below offset
+
+        ====================================================================*/
+        u32 OutOfBandFreeListAllocator::LowerBound( const u32* offsets, u32 count, u32 offset ) const
+        {
+            u32 low = 0;
+            u32 high = count;
+
+            while( low < high )
+            {
+                u32 mid = low + ( ( high - low ) >> 1 );
+
+                if( offsets[ mid ] < offset )
+                {
+                    low = mid + 1;
+                }
+                else
+                {
+                    high = mid;
+                }
+            }
+
+            return low;
+        }
+
+
+        /*====================================================================
+
+            OutOfBandFreeListAllocator::FindUsedBlock
+            - ptr is range checked against the managed memory before it is
+              turned into an offset, so foreign pointers are never truncated
+              onto a block
+            - @return: index of the in use block starting at ptr, or
+              INVALID_INDEX if there is none
+
+        ====================================================================*/
+        u32 OutOfBandFreeListAllocator::FindUsedBlock( const void* ptr ) const
+        {
+            size_t addr = ( size_t )ptr;
+            size_t base = ( size_t )m_base;
+
+            if( addr < base || addr - base >= m_size )
+            {
+                return INVALID_INDEX;
+            }
+
+            u32 offset = ( u32 )( addr - base );
+            u32 index = LowerBound( m_usedOffsets, m_numUsed, offset );
+
+            if( index < m_numUsed && m_usedOffsets[ index ] == offset )
+            {
+                return index;
+            }
+
+            return INVALID_INDEX;
+        }
+
+
+        /*====================================================================
+
+            OutOfBandFreeListAllocator::InsertFree / RemoveFree
+            - keep the free table packed and sorted by offset. both shift
+              the entries above index, so cost grows with the table
+
+        ====================================================================*/
+        void OutOfBandFreeListAllocator::InsertFree( u32 index, u32 offset, u32 size )
+        {
+            DEBUG_ASSERT( m_numFree <= m_maxBlocks && "Free table overflow" );
+
+            memmove( m_freeOffsets + index + 1, m_freeOffsets + index, ( m_numFree - index ) * sizeof( u32 ) );
+            memmove( m_freeSizes + index + 1, m_freeSizes + index, ( m_numFree - index ) * sizeof( u32 ) );
+
+            m_freeOffsets[ index ] = offset;
+            m_freeSizes[ index ] = size;
+            ++m_numFree;
+        }
+
+        void OutOfBandFreeListAllocator::RemoveFree( u32 index )
+        {
+            memmove( m_freeOffsets + index, m_freeOffsets + index + 1, ( m_numFree - index - 1 ) * sizeof( u32 ) );
+            memmove( m_freeSizes + index, m_freeSizes + index + 1, ( m_numFree - index - 1 ) * sizeof( u32 ) );
+            --m_numFree;
+        }
+    }
+}
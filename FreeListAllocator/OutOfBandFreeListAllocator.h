@@ -0,0 +1,79 @@
+#ifndef _BB_OUTOFBAND_FREELIST_ALLOCATOR_H_ // [ _BB_OUTOFBAND_FREELIST_ALLOCATOR_H_
+#define _BB_OUTOFBAND_FREELIST_ALLOCATOR_H_
+
+#include "engine/memory/Allocator.h"
+
+namespace bbengine
+{
+    namespace mem
+    {
+        // Free list allocator that keeps all of its block metadata in side
+        // tables instead of headers inside the managed memory. Free blocks
+        // are searched with a linear scan over a dense array of sizes, and
+        // the managed memory is never read or written by the allocator, so
+        // it can manage memory the CPU should not touch ( ie GPU memory )
+        //
+        // the tables are packed arrays, so finding a block is a binary
+        // search but adding or removing one moves every entry above it:
+        // Allocate and Free are O(n) in the number of blocks. the entries
+        // are 4 bytes and moved with memmove, which stays cheap for the
+        // few thousand large blocks this is meant for; heaps with many
+        // small blocks want BasicFreeListAllocator instead
+        class OutOfBandFreeListAllocator : public Allocator
+        {
+        public:
+
+            // manage an internal heap of heapSize bytes
+            OutOfBandFreeListAllocator( u32 heapSize, u32 maxBlocks );
+            // manage memory owned by someone else. memory is never dereferenced
+            OutOfBandFreeListAllocator( void* memory, u32 memorySize, u32 maxBlocks );
+            ~OutOfBandFreeListAllocator( );
+
+            using Allocator::AllocateAligned;
+            using Allocator::Free;
+
+            virtual void*   Allocate( u32 numBytes );
+            virtual void*   AllocateAligned( u32 numBytes, const align_t alignment );
+            virtual void    Free( void* ptr );
+            virtual u32     GetBlockSize( void* ptr );
+
+            // releases every block at once
+            void            Reset( );
+
+            // false if there was no memory to manage or the metadata tables
+            // could not be allocated, in which case every allocation fails
+            bool            IsInitialized( ) const  { return m_freeOffsets != NULL; }
+
+        private:
+
+            OutOfBandFreeListAllocator( OutOfBandFreeListAllocator& );
+
+            bool            Init( void* memory, u32 memorySize, u32 maxBlocks );
+            u32             FindUsedBlock( const void* ptr ) const;
+            u32             LowerBound( const u32* offsets, u32 count, u32 offset ) const;
+            void            InsertFree( u32 index, u32 offset, u32 size );
+            void            RemoveFree( u32 index );
+
+            // a table is a pair of arrays sorted by offset. offsets are
+            // relative to m_base so the tables stay half the size of
+            // pointers on 64-bit targets
+            byte*       m_base;         // start of the managed memory
+            u32         m_size;         // size in bytes of the managed memory
+            bool        m_ownsMemory;   // true if m_base was allocated by this allocator
+
+            u32         m_maxBlocks;    // capacity of each table
+
+            u32*        m_freeOffsets;  // address-ordered free blocks
+            u32*        m_freeSizes;
+            u32         m_numFree;
+
+            u32*        m_usedOffsets;  // address-ordered in use blocks
+            u32*        m_usedSizes;
+            u32         m_numUsed;
+        };
+    }
+}
+
+
+
+#endif // ] _BB_OUTOFBAND_FREELIST_ALLOCATOR_H_
@@ -0,0 +1,498 @@
+#include "engine/memory/ThreadBufferedWriter.h"
+#include "engine/system/Assert.h"
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+
+namespace bbengine
+{
+    namespace mem
+    {
+        // the slots of every writer the calling thread has written to. the
+        // destructor hands the partial buffers to their writers when the
+        // thread exits
+        struct thread_slots_s
+        {
+            ThreadBufferedWriter::thread_slot_s*    head;
+            u32                                     threadId;   // 0 until the thread first writes
+
+            ~thread_slots_s( );
+        };
+
+        static thread_local thread_slots_s s_threadSlots = { NULL, 0 };
+        static std::atomic< u32 > s_nextThreadId( 1 );
+
+        // guards the writers' slot lists and hands slots from a writer back
+        // to their thread. only taken when a thread starts writing to a
+        // writer, exits or a writer stops, never for each event
+        static std::mutex& GetSlotMutex( )
+        {
+            static std::mutex s_slotMutex;
+            return s_slotMutex;
+        }
+
+
+        /*====================================================================
+
+            thread_slots_s::~thread_slots_s
+            - hands the exiting thread's partial buffers to the writers that
+              are still running and frees its slots
+
+        ====================================================================*/
+        thread_slots_s::~thread_slots_s( )
+        {
+            std::lock_guard< std::mutex > lock( GetSlotMutex() );
+
+            while( head )
+            {
+                ThreadBufferedWriter::thread_slot_s* slot = head;
+                head = slot->nextInThread;
+
+                ThreadBufferedWriter* writer = slot->writer.load();
+
+                if( writer )
+                {
+                    writer->ReleaseSlot( slot );
+                }
+
+                free( slot );
+            }
+        }
+
+
+        /*====================================================================
+
+            ThreadBufferedWriter::ThreadBufferedWriter( u32 eventSize, u32 eventsPerBuffer )
+
+        ====================================================================*/
+        ThreadBufferedWriter::ThreadBufferedWriter( u32 eventSize, u32 eventsPerBuffer )
+            : m_eventSize( eventSize )
+            , m_eventsPerBuffer( eventsPerBuffer )
+            , m_write( NULL )
+            , m_userData( NULL )
+            , m_running( false )
+            , m_droppedEvents( 0 )
+            , m_slots( NULL )
+            , m_stopping( false )
+            , m_fullBuffers( NULL )
+            , m_fullTail( NULL )
+            , m_spareBuffers( NULL )
+        {
+            DEBUG_ASSERT( eventSize > 0 && eventsPerBuffer > 0 && "Empty events or buffers" );
+        }
+
+
+        /*====================================================================
+
+            ThreadBufferedWriter::~ThreadBufferedWriter
+            - stops the writer and releases all buffers. Stop leaves none in
+              the threads' slots or the queue, so only the spares are left
+
+        ====================================================================*/
+        ThreadBufferedWriter::~ThreadBufferedWriter( )
+        {
+            Stop();
+
+            DEBUG_ASSERT( m_slots == NULL && m_fullBuffers == NULL && "Buffers left after stopping" );
+
+            while( m_spareBuffers )
+            {
+                buffer_s* next = m_spareBuffers->next;
+                free( m_spareBuffers );
+                m_spareBuffers = next;
+            }
+        }
+
+
+        /*====================================================================
+
+            ThreadBufferedWriter::Start( write_events_t write, void* userData )
+            - starts the background thread. anything the caller writes
+              ahead of the events, ie a file header, must be written first
+
+        ====================================================================*/
+        void ThreadBufferedWriter::Start( write_events_t write, void* userData )
+        {
+            DEBUG_ASSERT( !m_running.load() && "Writer already started" );
+
+            m_write = write;
+            m_userData = userData;
+            m_stopping = false;
+            m_writer = std::thread( &ThreadBufferedWriter::WriterThread, this );
+
+            std::lock_guard< std::mutex > lock( GetSlotMutex() );
+            m_running.store( true );
+        }
+
+
+        /*====================================================================
+
+            ThreadBufferedWriter::Stop
+            - takes every thread's buffer back, queues the ones with events
+              in them and waits for the background thread to write out the
+              whole queue. threads that write after this drop their slot
+              the next time they write to a running writer
+
+        ====================================================================*/
+        void ThreadBufferedWriter::Stop( )
+        {
+            {
+                std::lock_guard< std::mutex > lock( GetSlotMutex() );
+
+                if( !m_running.load() )
+                {
+                    return;
+                }
+
+                m_running.store( false );
+
+                while( m_slots )
+                {
+                    ReleaseSlot( m_slots );
+                }
+            }
+
+            {
+                std::lock_guard< std::mutex > lock( m_mutex );
+                m_stopping = true;
+            }
+
+            m_wake.notify_one();
+            m_writer.join();
+        }
+
+
+        /*====================================================================
+
+            ThreadBufferedWriter::Write( const void* event )
+            - copies an event into the calling thread's buffer, queueing the
+              buffer once it is full
+            - busy tells Stop and exiting threads that the buffer is being
+              written to. it is set before the slot's writer is checked and
+              ReleaseSlot clears the writer before waiting on busy, so
+              either this sees the slot released or ReleaseSlot waits
+
+        ====================================================================*/
+        bool ThreadBufferedWriter::Write( const void* event )
+        {
+            if( !m_running.load( std::memory_order_relaxed ) )
+            {
+                return false;
+            }
+
+            thread_slot_s* slot = s_threadSlots.head;
+
+            while( slot && slot->writer.load( std::memory_order_relaxed ) != this )
+            {
+                slot = slot->nextInThread;
+            }
+
+            if( slot == NULL )
+            {
+                slot = AddSlot();
+
+                if( slot == NULL )
+                {
+                    return false;
+                }
+            }
+
+            slot->busy.store( 1 );
+
+            if( slot->writer.load() != this )
+            {
+                // stopped since the check above
+                slot->busy.store( 0, std::memory_order_release );
+                return false;
+            }
+
+            buffer_s* buffer = slot->buffer;
+
+            if( buffer == NULL )
+            {
+                buffer = AcquireBuffer( slot->threadId );
+                slot->buffer = buffer;
+
+                if( buffer == NULL )
+                {
+                    slot->busy.store( 0, std::memory_order_release );
+                    m_droppedEvents.fetch_add( 1, std::memory_order_relaxed );
+                    return false;
+                }
+            }
+
+            memcpy( ( byte* )buffer + EVENTS_OFFSET + buffer->count * m_eventSize, event, m_eventSize );
+
+            if( ++buffer->count == m_eventsPerBuffer )
+            {
+                slot->buffer = NULL;
+                SubmitBuffer( buffer );
+            }
+
+            slot->busy.store( 0, std::memory_order_release );
+
+            return true;
+        }
+
+
+        /*====================================================================
+
+            ThreadBufferedWriter::FlushThread
+            - queues the calling thread's buffer, even if it is not full, so
+              its events are written now rather than when it fills up, the
+              thread exits or the writer stops
+
+        ====================================================================*/
+        void ThreadBufferedWriter::FlushThread( )
+        {
+            thread_slot_s* slot = s_threadSlots.head;
+
+            while( slot && slot->writer.load( std::memory_order_relaxed ) != this )
+            {
+                slot = slot->nextInThread;
+            }
+
+            if( slot == NULL )
+            {
+                return;
+            }
+
+            slot->busy.store( 1 );
+
+            if( slot->writer.load() == this && slot->buffer && slot->buffer->count )
+            {
+                SubmitBuffer( slot->buffer );
+                slot->buffer = NULL;
+            }
+
+            slot->busy.store( 0, std::memory_order_release );
+        }
+
+
+        /*====================================================================
+
+            ThreadBufferedWriter::AddSlot
+            - gives the calling thread a slot in this writer, first freeing
+              any of its slots that stopped writers have let go of
+            - @return: NULL if the writer has stopped or out of memory
+
+        ====================================================================*/
+        ThreadBufferedWriter::thread_slot_s* ThreadBufferedWriter::AddSlot( )
+        {
+            thread_slots_s& slots = s_threadSlots;
+
+            std::lock_guard< std::mutex > lock( GetSlotMutex() );
+
+            thread_slot_s** link = &slots.head;
+
+            while( *link )
+            {
+                thread_slot_s* slot = *link;
+
+                if( slot->writer.load( std::memory_order_relaxed ) == NULL )
+                {
+                    *link = slot->nextInThread;
+                    free( slot );
+                }
+                else
+                {
+                    link = &slot->nextInThread;
+                }
+            }
+
+            if( !m_running.load( std::memory_order_relaxed ) )
+            {
+                return NULL;
+            }
+
+            void* memory = malloc( sizeof( thread_slot_s ) );
+
+            if( memory == NULL )
+            {
+                m_droppedEvents.fetch_add( 1, std::memory_order_relaxed );
+                return NULL;
+            }
+
+            if( slots.threadId == 0 )
+            {
+                slots.threadId = s_nextThreadId.fetch_add( 1 );
+            }
+
+            thread_slot_s* slot = new( memory ) thread_slot_s;
+            slot->writer.store( this, std::memory_order_relaxed );
+            slot->busy.store( 0, std::memory_order_relaxed );
+            slot->buffer = NULL;
+            slot->threadId = slots.threadId;
+            slot->nextInWriter = m_slots;
+            slot->nextInThread = slots.head;
+
+            m_slots = slot;
+            slots.head = slot;
+
+            return slot;
+        }
+
+
+        /*====================================================================
+
+            ThreadBufferedWriter::ReleaseSlot( thread_slot_s* slot )
+            - takes a slot out of the writer once its thread is done with
+              the buffer, queueing the buffer if it has events in it. the
+              slot itself stays with its thread, which frees it. called with
+              the slot mutex held
+
+        ====================================================================*/
+        void ThreadBufferedWriter::ReleaseSlot( thread_slot_s* slot )
+        {
+            slot->writer.store( NULL );
+
+            while( slot->busy.load() )
+            {
+                std::this_thread::yield();
+            }
+
+            thread_slot_s** link = &m_slots;
+
+            while( *link != slot )
+            {
+                link = &( *link )->nextInWriter;
+            }
+
+            *link = slot->nextInWriter;
+            slot->nextInWriter = NULL;
+
+            buffer_s* buffer = slot->buffer;
+            slot->buffer = NULL;
+
+            if( buffer == NULL )
+            {
+                return;
+            }
+
+            if( buffer->count )
+            {
+                SubmitBuffer( buffer );
+            }
+            else
+            {
+                std::lock_guard< std::mutex > lock( m_mutex );
+                buffer->next = m_spareBuffers;
+                m_spareBuffers = buffer;
+            }
+        }
+
+
+        /*====================================================================
+
+            ThreadBufferedWriter::AcquireBuffer( u32 threadId )
+            - @return: an empty buffer, reusing one the background thread is
+              done with when possible. NULL if out of memory
+
+        ====================================================================*/
+        ThreadBufferedWriter::buffer_s* ThreadBufferedWriter::AcquireBuffer( u32 threadId )
+        {
+            buffer_s* buffer = NULL;
+
+            {
+                std::lock_guard< std::mutex > lock( m_mutex );
+
+                if( m_spareBuffers )
+                {
+                    buffer = m_spareBuffers;
+                    m_spareBuffers = buffer->next;
+                }
+            }
+
+            if( buffer == NULL )
+            {
+                buffer = ( buffer_s* )malloc( EVENTS_OFFSET + ( size_t )m_eventSize * m_eventsPerBuffer );
+
+                if( buffer == NULL )
+                {
+                    return NULL;
+                }
+            }
+
+            buffer->next = NULL;
+            buffer->count = 0;
+            buffer->threadId = threadId;
+
+            return buffer;
+        }
+
+
+        /*====================================================================
+
+            ThreadBufferedWriter::SubmitBuffer( buffer_s* buffer )
+            - queues a buffer for the background thread
+
+        ====================================================================*/
+        void ThreadBufferedWriter::SubmitBuffer( buffer_s* buffer )
+        {
+            buffer->next = NULL;
+
+            {
+                std::lock_guard< std::mutex > lock( m_mutex );
+
+                if( m_fullTail )
+                {
+                    m_fullTail->next = buffer;
+                }
+                else
+                {
+                    m_fullBuffers = buffer;
+                }
+
+                m_fullTail = buffer;
+            }
+
+            m_wake.notify_one();
+        }
+
+
+        /*====================================================================
+
+            ThreadBufferedWriter::WriterThread
+            - passes full buffers to m_write in the order they were queued
+              until Stop is called and the queue is empty
+
+        ====================================================================*/
+        void ThreadBufferedWriter::WriterThread( )
+        {
+            std::unique_lock< std::mutex > lock( m_mutex );
+
+            for( ;; )
+            {
+                while( m_fullBuffers == NULL && !m_stopping )
+                {
+                    m_wake.wait( lock );
+                }
+
+                if( m_fullBuffers == NULL )
+                {
+                    // stopping and nothing left to write
+                    break;
+                }
+
+                buffer_s* buffers = m_fullBuffers;
+                m_fullBuffers = NULL;
+                m_fullTail = NULL;
+
+                lock.unlock();
+
+                buffer_s* last = buffers;
+
+                for( buffer_s* buffer = buffers; buffer; buffer = buffer->next )
+                {
+                    m_write( m_userData, ( byte* )buffer + EVENTS_OFFSET, buffer->count, buffer->threadId );
+                    last = buffer;
+                }
+
+                lock.lock();
+
+                last->next = m_spareBuffers;
+                m_spareBuffers = buffers;
+            }
+        }
+    }
+}
@@ -0,0 +1,113 @@
+#ifndef _BB_THREAD_BUFFERED_WRITER_H_ // [ _BB_THREAD_BUFFERED_WRITER_H_
+#define _BB_THREAD_BUFFERED_WRITER_H_
+
+#include "engine/system/System.h"
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace bbengine
+{
+    namespace mem
+    {
+        // hands a batch of events written by one thread to whoever owns the
+        // writer. called on the writer's background thread, one batch at a
+        // time and in the order the batches were filled
+        typedef void ( *write_events_t )( void* userData, const void* events, u32 count, u32 threadId );
+
+
+        // Collects fixed size events from any number of threads and writes
+        // them out on a background thread, for the recorders that trace
+        // allocator activity. Each thread writes into a buffer of its own,
+        // so writing an event is a thread local lookup and a copy, and full
+        // buffers are queued for the background thread. Buffers come from
+        // malloc, never from an allocator being traced.
+        //
+        // the writer keeps track of every thread's buffer. Stop writes out
+        // the events in all of them, and a thread's partial buffer is
+        // written when the thread exits. events that can't be stored, ie
+        // when malloc fails, are counted and dropped. Start and Stop must
+        // not be called from several threads at once, and nothing may write
+        // to the writer while it is being destroyed
+        class ThreadBufferedWriter
+        {
+        public:
+            ThreadBufferedWriter( u32 eventSize, u32 eventsPerBuffer );
+            ~ThreadBufferedWriter( );
+
+            // starts the background thread, which passes every batch to write
+            void            Start( write_events_t write, void* userData );
+            // writes out every thread's events and stops the background
+            // thread. events written after this are ignored
+            void            Stop( );
+
+            // copies eventSize bytes into the calling thread's buffer.
+            // @return: false if the event was ignored or dropped
+            bool            Write( const void* event );
+            // queues the calling thread's partially filled buffer, so its
+            // events are written without waiting for it to fill up
+            void            FlushThread( );
+
+            bool            IsRunning( ) const          { return m_running.load( std::memory_order_relaxed ); }
+            // events dropped because a buffer could not be allocated
+            u64             GetDroppedEvents( ) const   { return m_droppedEvents.load( std::memory_order_relaxed ); }
+
+            struct buffer_s
+            {
+                buffer_s*   next;
+                u32         count;
+                u32         threadId;
+                // followed by eventsPerBuffer events of eventSize bytes,
+                // starting at EVENTS_OFFSET
+            };
+
+            static const u32 EVENTS_OFFSET = ( sizeof( buffer_s ) + 7u ) & ~7u;
+
+            // a thread's buffer for one writer. owned by the thread, which
+            // frees it once the writer has let go of it
+            struct thread_slot_s
+            {
+                std::atomic< ThreadBufferedWriter* >    writer;     // NULL once the writer has let go
+                std::atomic< u32 >                      busy;       // the thread is writing into buffer
+                buffer_s*                               buffer;     // NULL until the thread next writes
+                u32                                     threadId;
+                thread_slot_s*                          nextInWriter;
+                thread_slot_s*                          nextInThread;
+            };
+
+        private:
+            ThreadBufferedWriter( ThreadBufferedWriter& );
+
+            thread_slot_s*  AddSlot( );
+            void            ReleaseSlot( thread_slot_s* slot );
+            buffer_s*       AcquireBuffer( u32 threadId );
+            void            SubmitBuffer( buffer_s* buffer );
+            void            WriterThread( );
+
+            friend struct thread_slots_s;
+
+            const u32                   m_eventSize;
+            const u32                   m_eventsPerBuffer;
+
+            write_events_t              m_write;
+            void*                       m_userData;
+            std::atomic< bool >         m_running;
+            std::atomic< u64 >          m_droppedEvents;
+
+            thread_slot_s*              m_slots;            // every thread's slot, guarded by the slot mutex
+
+            std::thread                 m_writer;
+            std::mutex                  m_mutex;            // guards the buffer queues
+            std::condition_variable     m_wake;
+            bool                        m_stopping;
+
+            buffer_s*                   m_fullBuffers;      // waiting to be written, oldest first
+            buffer_s*                   m_fullTail;
+            buffer_s*                   m_spareBuffers;     // written and ready for reuse
+        };
+    }
+}
+
+
+#endif // ] _BB_THREAD_BUFFERED_WRITER_H_
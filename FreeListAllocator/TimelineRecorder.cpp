@@ -0,0 +1,261 @@
+#include "engine/memory/TimelineRecorder.h"
+#include "engine/system/Assert.h"
+#include <chrono>
+#include <thread>
+
+#if defined( _WIN32 )
+    #include <process.h>
+    #define BB_GETPID _getpid
+#else
+    #include <unistd.h>
+    #define BB_GETPID getpid
+#endif
+
+namespace bbengine
+{
+    namespace mem
+    {
+        /*====================================================================
+
+            TimelineRecorder::TimelineRecorder
+
+        ====================================================================*/
+        TimelineRecorder::TimelineRecorder( )
+            : m_file( NULL )
+            , m_events( sizeof( timeline_event_s ), EVENTS_PER_BUFFER )
+            , m_startTime( 0 )
+            , m_cyclesPerMicrosecond( 1.0 )
+            , m_processId( 0 )
+            , m_wroteEvent( false )
+        {
+        }
+
+
+        /*====================================================================
+
+            TimelineRecorder::~TimelineRecorder
+            - stops recording. the writer releases the buffers
+
+        ====================================================================*/
+        TimelineRecorder::~TimelineRecorder( )
+        {
+            Stop();
+        }
+
+
+        /*====================================================================
+
+            TimelineRecorder::Start( const char* path )
+            - measures the cycle counter against the system clock, opens the
+              trace file and starts the background writer thread
+            - @return: false if the file could not be opened
+
+        ====================================================================*/
+        bool TimelineRecorder::Start( const char* path )
+        {
+            DEBUG_ASSERT( m_file == NULL && "Timeline recorder already started" );
+
+            FILE* file = fopen( path, "w" );
+
+            if( file == NULL )
+            {
+                return false;
+            }
+
+            std::chrono::steady_clock::time_point clockStart = std::chrono::steady_clock::now();
+            u64 cycleStart = ReadCycleCounter();
+
+            std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+
+            u64 cycles = ReadCycleCounter() - cycleStart;
+            double microseconds = std::chrono::duration< double, std::micro >( std::chrono::steady_clock::now() - clockStart ).count();
+
+            m_cyclesPerMicrosecond = cycles && microseconds > 0.0 ? ( double )cycles / microseconds : 1.0;
+            m_startTime = cycleStart;
+            m_processId = ( u32 )BB_GETPID();
+            m_wroteEvent = false;
+
+            fprintf( file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[" );
+
+            m_file = file;
+            m_events.Start( &TimelineRecorder::WriteEvents, this );
+
+            return true;
+        }
+
+
+        /*====================================================================
+
+            TimelineRecorder::Stop
+            - writes out every thread's events, ends the JSON and closes the
+              file
+
+        ====================================================================*/
+        void TimelineRecorder::Stop( )
+        {
+            m_events.Stop();
+
+            if( m_file == NULL )
+            {
+                return;
+            }
+
+            fprintf( m_file, "\n]}\n" );
+            fclose( m_file );
+            m_file = NULL;
+        }
+
+
+        /*====================================================================
+
+            TimelineRecorder::MicrosecondsToCycles( u32 microseconds )
+            - @return: cycle counter ticks in microseconds. only meaningful
+              once Start has been called
+
+        ====================================================================*/
+        u64 TimelineRecorder::MicrosecondsToCycles( u32 microseconds ) const
+        {
+            return ( u64 )( ( double )microseconds * m_cyclesPerMicrosecond );
+        }
+
+
+        /*====================================================================
+
+            TimelineRecorder::Record( const timeline_event_s& event )
+            - appends an event to the calling thread's buffer
+
+        ====================================================================*/
+        void TimelineRecorder::Record( const timeline_event_s& event )
+        {
+            m_events.Write( &event );
+        }
+
+
+        /*====================================================================
+
+            TimelineRecorder::Slice
+            - records a slice from startTime to endTime with up to two
+              integer args
+
+        ====================================================================*/
+        void TimelineRecorder::Slice( const char* name, u64 startTime, u64 endTime,
+                                      const char* argName0, u64 arg0, const char* argName1, u64 arg1 )
+        {
+            timeline_event_s event;
+            event.timestamp = startTime;
+            event.duration = endTime - startTime;
+            event.name = name;
+            event.argNames[ 0 ] = argName0;
+            event.argNames[ 1 ] = argName1;
+            event.args[ 0 ] = arg0;
+            event.args[ 1 ] = arg1;
+            event.type = TIMELINE_SLICE;
+
+            Record( event );
+        }
+
+
+        /*====================================================================
+
+            TimelineRecorder::Counter
+            - records the value of the counter track name at timestamp
+
+        ====================================================================*/
+        void TimelineRecorder::Counter( const char* name, u64 timestamp, u64 value )
+        {
+            timeline_event_s event;
+            event.timestamp = timestamp;
+            event.duration = 0;
+            event.name = name;
+            event.argNames[ 0 ] = "value";
+            event.argNames[ 1 ] = NULL;
+            event.args[ 0 ] = value;
+            event.args[ 1 ] = 0;
+            event.type = TIMELINE_COUNTER;
+
+            Record( event );
+        }
+
+
+        /*====================================================================
+
+            TimelineRecorder::Instant
+            - records a marker at timestamp, ie the start of a frame
+
+        ====================================================================*/
+        void TimelineRecorder::Instant( const char* name, u64 timestamp )
+        {
+            timeline_event_s event;
+            event.timestamp = timestamp;
+            event.duration = 0;
+            event.name = name;
+            event.argNames[ 0 ] = NULL;
+            event.argNames[ 1 ] = NULL;
+            event.args[ 0 ] = 0;
+            event.args[ 1 ] = 0;
+            event.type = TIMELINE_INSTANT;
+
+            Record( event );
+        }
+
+
+        /*====================================================================
+
+            TimelineRecorder::WriteEvents
+            - writes a buffer of events to the file, on the writer thread
+
+        ====================================================================*/
+        void TimelineRecorder::WriteEvents( void* userData, const void* events, u32 count, u32 threadId )
+        {
+            TimelineRecorder* recorder = ( TimelineRecorder* )userData;
+            const timeline_event_s* event = ( const timeline_event_s* )events;
+
+            for( u32 i = 0; i < count; ++i )
+            {
+                recorder->WriteEvent( event[ i ], threadId );
+            }
+        }
+
+
+        /*====================================================================
+
+            TimelineRecorder::WriteEvent
+            - writes one event as a Chrome trace JSON object. timestamps are
+              microseconds since Start
+
+        ====================================================================*/
+        void TimelineRecorder::WriteEvent( const timeline_event_s& event, u32 threadId )
+        {
+            static const char* PHASES[] = { "X", "C", "i" };
+
+            double timestamp = ( ( double )event.timestamp - ( double )m_startTime ) / m_cyclesPerMicrosecond;
+
+            fprintf( m_file, "%s\n{\"name\":\"%s\",\"cat\":\"memory\",\"ph\":\"%s\",\"ts\":%.3f,\"pid\":%u,\"tid\":%u",
+                     m_wroteEvent ? "," : "", event.name, PHASES[ event.type ], timestamp, m_processId, threadId );
+
+            if( event.type == TIMELINE_SLICE )
+            {
+                fprintf( m_file, ",\"dur\":%.3f", ( double )event.duration / m_cyclesPerMicrosecond );
+            }
+            else if( event.type == TIMELINE_INSTANT )
+            {
+                fprintf( m_file, ",\"s\":\"p\"" );
+            }
+
+            if( event.argNames[ 0 ] )
+            {
+                fprintf( m_file, ",\"args\":{\"%s\":%llu", event.argNames[ 0 ], ( unsigned long long )event.args[ 0 ] );
+
+                if( event.argNames[ 1 ] )
+                {
+                    fprintf( m_file, ",\"%s\":%llu", event.argNames[ 1 ], ( unsigned long long )event.args[ 1 ] );
+                }
+
+                fprintf( m_file, "}" );
+            }
+
+            fprintf( m_file, "}" );
+            m_wroteEvent = true;
+        }
+    }
+}
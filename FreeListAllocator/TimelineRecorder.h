@@ -0,0 +1,196 @@
+#ifndef _BB_TIMELINE_RECORDER_H_ // [ _BB_TIMELINE_RECORDER_H_
+#define _BB_TIMELINE_RECORDER_H_
+
+#include "engine/memory/FreeListStats.h"
+#include "engine/memory/LogHistogram.h"
+#include "engine/memory/ThreadBufferedWriter.h"
+#include <stdio.h>
+
+namespace bbengine
+{
+    namespace mem
+    {
+        enum timeline_event_e
+        {
+            TIMELINE_SLICE              = 0,    // name, start and duration
+            TIMELINE_COUNTER            = 1,    // name and args[ 0 ] at a point in time
+            TIMELINE_INSTANT            = 2,    // name at a point in time
+        };
+
+        // names are not copied, so they must be string literals or
+        // otherwise live until the recorder is stopped
+        struct timeline_event_s
+        {
+            u64             timestamp;          // ReadCycleCounter()
+            u64             duration;           // cycles, slices only
+            const char*     name;
+            const char*     argNames[ 2 ];      // NULL for no arg
+            u64             args[ 2 ];
+            u32             type;               // timeline_event_e
+        };
+
+
+        // Records timeline events and writes them out as Chrome trace JSON,
+        // which chrome://tracing and the Perfetto UI both load. Game code
+        // can record its own frame markers next to the allocator's events.
+        // Events are buffered per thread by a ThreadBufferedWriter, whose
+        // background thread formats and writes them, so recording is a
+        // thread local lookup and a copy. A thread's events are written
+        // when its buffer fills, when it calls FlushThread or exits, and
+        // when the recorder stops
+        class TimelineRecorder
+        {
+        public:
+            TimelineRecorder( );
+            ~TimelineRecorder( );
+
+            // opens the trace file and starts the writer thread. blocks for a
+            // few milliseconds to measure the cycle counter's rate
+            bool            Start( const char* path );
+            // writes out every thread's events and closes the file
+            void            Stop( );
+
+            void            Slice( const char* name, u64 startTime, u64 endTime,
+                                   const char* argName0 = NULL, u64 arg0 = 0, const char* argName1 = NULL, u64 arg1 = 0 );
+            void            Counter( const char* name, u64 timestamp, u64 value );
+            void            Instant( const char* name, u64 timestamp );
+
+            // hands the calling thread's partially filled buffer to the writer
+            void            FlushThread( )          { m_events.FlushThread(); }
+
+            bool            IsRecording( ) const    { return m_events.IsRunning(); }
+            // events lost because a buffer could not be allocated
+            u64             GetDroppedEvents( ) const   { return m_events.GetDroppedEvents(); }
+            u64             MicrosecondsToCycles( u32 microseconds ) const;
+
+            static const u32 EVENTS_PER_BUFFER = 2048;
+
+        private:
+            TimelineRecorder( TimelineRecorder& );
+
+            void            Record( const timeline_event_s& event );
+            static void     WriteEvents( void* userData, const void* events, u32 count, u32 threadId );
+            void            WriteEvent( const timeline_event_s& event, u32 threadId );
+
+            FILE*                       m_file;             // only used by Start, Stop and the writer thread
+            ThreadBufferedWriter        m_events;
+
+            u64                         m_startTime;        // ReadCycleCounter() at Start
+            double                      m_cyclesPerMicrosecond;
+            u32                         m_processId;
+            bool                        m_wroteEvent;       // writer thread only
+        };
+
+
+        // StatsPolicy that keeps heap_stats_s like HeapStatsPolicy and sends
+        // allocator activity to a TimelineRecorder:
+        // - "bytes in use" and "free blocks" counters, at most once per
+        //   counter interval
+        // - a slice for every AllocateAligned and Free call that takes at
+        //   least the slow threshold. frees that coalesced blocks are named
+        //   "Free (coalesce)". a threshold of 0 records every call
+        class TimelineStatsPolicy : public HeapStatsPolicy
+        {
+        public:
+            TimelineStatsPolicy( )
+                : m_recorder( NULL ), m_slowCycles( 0 ), m_counterCycles( 0 ), m_lastCounterTime( 0 ), m_blocksJoined( 0 )
+            {
+            }
+
+            static const bool TIMED_OPERATIONS = true;
+
+            // the recorder must already be started, so its cycle rate is known
+            void SetRecorder( TimelineRecorder* recorder, u32 slowMicroseconds = 10, u32 counterMicroseconds = 100 )
+            {
+                m_recorder = recorder;
+
+                if( recorder )
+                {
+                    m_slowCycles = recorder->MicrosecondsToCycles( slowMicroseconds );
+                    m_counterCycles = recorder->MicrosecondsToCycles( counterMicroseconds );
+                }
+            }
+
+            void OnReset( )
+            {
+                HeapStatsPolicy::OnReset();
+                m_blocksJoined = 0;
+            }
+
+            void OnFreeBlocksJoined( u32 firstSize, u32 secondSize, u32 joinedSize )
+            {
+                HeapStatsPolicy::OnFreeBlocksJoined( firstSize, secondSize, joinedSize );
+                ++m_blocksJoined;
+            }
+
+            void OnAllocateDone( u64 startTime, u32 numBytes, align_t alignment, void* ptr, u32 tag, u32 blocksVisited )
+            {
+                ( void )alignment; ( void )tag;
+
+                if( m_recorder == NULL )
+                {
+                    return;
+                }
+
+                u64 now = ReadCycleCounter();
+
+                if( now - startTime >= m_slowCycles )
+                {
+                    m_recorder->Slice( ptr ? "Allocate" : "Allocate (failed)", startTime, now,
+                                       "bytes", numBytes, "blocksVisited", blocksVisited );
+                }
+
+                RecordCounters( now );
+            }
+
+            void OnFreeDone( u64 startTime, void* ptr, u32 tag, u32 blocksVisited )
+            {
+                ( void )ptr; ( void )tag;
+
+                u32 blocksJoined = m_blocksJoined;
+                m_blocksJoined = 0;
+
+                if( m_recorder == NULL )
+                {
+                    return;
+                }
+
+                u64 now = ReadCycleCounter();
+
+                if( now - startTime >= m_slowCycles )
+                {
+                    m_recorder->Slice( blocksJoined ? "Free (coalesce)" : "Free", startTime, now,
+                                       "blocksVisited", blocksVisited, "blocksJoined", blocksJoined );
+                }
+
+                RecordCounters( now );
+            }
+
+        private:
+            void RecordCounters( u64 now )
+            {
+                if( now - m_lastCounterTime < m_counterCycles )
+                {
+                    return;
+                }
+
+                m_lastCounterTime = now;
+
+                heap_stats_s stats;
+                GetStats( stats );
+
+                m_recorder->Counter( "bytes in use", now, stats.bytesInUse );
+                m_recorder->Counter( "free blocks", now, stats.freeBlockCount );
+            }
+
+            TimelineRecorder*   m_recorder;
+            u64                 m_slowCycles;
+            u64                 m_counterCycles;
+            u64                 m_lastCounterTime;
+            u32                 m_blocksJoined;     // by the Free in progress
+        };
+    }
+}
+
+
+#endif // ] _BB_TIMELINE_RECORDER_H_